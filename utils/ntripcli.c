@@ -1,6 +1,9 @@
 #include "ntripcli.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <ctype.h>
+#include "wtime.h"
 
 static const unsigned char base64_table[65] =
 	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
@@ -70,6 +73,157 @@ enum NtripCliStep {
     STEP_DONE = 3,
 };
 
+// response header parsing state
+enum HeaderState {
+    HDR_STATUS, // status line
+    HDR_FIELDS, // header fields of HTTP response
+};
+
+// chunked transfer decoding state
+enum ChunkState {
+    CHUNK_SIZE,     // chunk size in hex
+    CHUNK_EXT,      // chunk extension, ignored
+    CHUNK_SIZE_LF,  // LF of chunk size line
+    CHUNK_DATA,     // chunk data
+    CHUNK_DATA_CR,  // CRLF after chunk data
+    CHUNK_DATA_LF,
+};
+
+// case insensitive prefix match, return 1 if s starts with prefix.
+static int match_prefix(const char *s, const char *prefix)
+{
+    while (*prefix) {
+        if (tolower((unsigned char)*s++) != tolower((unsigned char)*prefix++)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int hex_value(unsigned char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c = tolower(c);
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// write v in width digits with leading zeros, return end of digits.
+static char *put_digits(char *p, uint64_t v, int width)
+{
+    for (int i = width - 1; i >= 0; i--) {
+        p[i] = '0' + v % 10;
+        v /= 10;
+    }
+    return p + width;
+}
+
+// write v without leading zeros, return end of digits.
+static char *put_uint(char *p, uint64_t v)
+{
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v > 0);
+    while (n > 0) {
+        *p++ = tmp[--n];
+    }
+    return p;
+}
+
+// write angle as [d]ddmm.mmmmm and hemisphere
+static char *put_angle(char *p, double deg, int width, char pos, char neg)
+{
+    // minutes scaled by 1e5
+    uint64_t m = (uint64_t)((deg < 0 ? -deg : deg) * 6E6 + 0.5);
+    p = put_digits(p, m / 6000000, width);
+    p = put_digits(p, m % 6000000 / 100000, 2);
+    *p++ = '.';
+    p = put_digits(p, m % 100000, 5);
+    *p++ = ',';
+    *p++ = deg < 0 ? neg : pos;
+    *p++ = ',';
+    return p;
+}
+
+static int gga_valid(double lat, double lon, double alt)
+{
+    // also false for NaN
+    return lat >= -90 && lat <= 90 && lon >= -180 && lon <= 180 && alt > -1E6 && alt < 1E6;
+}
+
+int ntripcli_format_gga(char *buf, double lat, double lon, double alt, time_t t)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    if (!gga_valid(lat, lon, alt)) {
+        return -1;
+    }
+    char *p = buf;
+    memcpy(p, "$GPGGA,", 7);
+    p += 7;
+    long tod = (long)(t % 86400);
+    if (tod < 0) {
+        tod += 86400;
+    }
+    p = put_digits(p, tod / 3600, 2);
+    p = put_digits(p, tod / 60 % 60, 2);
+    p = put_digits(p, tod % 60, 2);
+    memcpy(p, ".00,", 4);
+    p += 4;
+    p = put_angle(p, lat, 2, 'N', 'S');
+    p = put_angle(p, lon, 3, 'E', 'W');
+    // quality, satellites, HDOP
+    memcpy(p, "1,12,1.0,", 9);
+    p += 9;
+    int64_t mm = (int64_t)(alt * 1000 + (alt < 0 ? -0.5 : 0.5));
+    if (mm < 0) {
+        *p++ = '-';
+        mm = -mm;
+    }
+    p = put_uint(p, mm / 1000);
+    *p++ = '.';
+    p = put_digits(p, mm % 1000, 3);
+    memcpy(p, ",M,0.0,M,,*", 11);
+    p += 11;
+    unsigned char sum = 0;
+    for (const char *c = buf + 1; c < p - 1; c++) {
+        sum ^= (unsigned char)*c;
+    }
+    *p++ = hex[sum >> 4];
+    *p++ = hex[sum & 0x0F];
+    *p++ = '\r';
+    *p++ = '\n';
+    *p = '\0';
+    return p - buf;
+}
+
+// format GGA of current position into ntrip->gga.
+// return 0 on success, -1 if position is not available.
+static int ntripcli_make_gga(struct ntripcli *ntrip, int64_t now)
+{
+    double lat = ntrip->gga_lat;
+    double lon = ntrip->gga_lon;
+    double alt = ntrip->gga_alt;
+    ntrip->gga_time = now;
+    ntrip->gga_len = 0;
+    ntrip->gga_off = 0;
+    if (ntrip->gga_cb && ntrip->gga_cb(ntrip, &lat, &lon, &alt, ntrip->gga_arg) == -1) {
+        return -1;
+    }
+    int len = ntripcli_format_gga(ntrip->gga, lat, lon, alt, time(NULL));
+    if (len == -1) {
+        return -1;
+    }
+    ntrip->gga_len = len;
+    return 0;
+}
+
 int ntripcli_init(struct ntripcli *ntrip,
                   float conn_timeout,
                   float inact_timeout,
@@ -83,11 +237,148 @@ int ntripcli_init(struct ntripcli *ntrip,
     ntrip->step = STEP_NEW;
     ntrip->cache[0] = '\0';
     ntrip->cache_idx = 0;
+    ntrip->cache_off = 0;
     ntrip->path_cache[0] = '\0';
+    ntrip->rtcm = NULL;
+    ntrip->table = NULL;
+    ntrip->version = 1;
+    ntrip->chunked = 0;
+    ntrip->hdr_state = HDR_STATUS;
+    ntrip->chunk_state = CHUNK_SIZE;
+    ntrip->chunk_digits = 0;
+    ntrip->chunk_size = 0;
+    ntrip->headers = NULL;
+    ntrip->headers_len = 0;
+    ntrip->req = NULL;
+    ntrip->req_len = 0;
+    ntrip->req_off = 0;
+    ntrip->req_dirty = 0;
+    ntrip->push = 0;
+    memset(&ntrip->outq, 0, sizeof(ntrip->outq));
+    ntrip->out_msgs = NULL;
+    ntrip->out_cap = 0;
+    ntrip->out_head = 0;
+    ntrip->out_count = 0;
+    ntrip->out_sent = 0;
+    ntrip->out_dropped = 0;
+    ntrip->gga_on = 0;
+    ntrip->gga_lat = 0;
+    ntrip->gga_lon = 0;
+    ntrip->gga_alt = 0;
+    ntrip->gga_cb = NULL;
+    ntrip->gga_arg = NULL;
+    ntrip->gga_interval = 0;
+    ntrip->gga_time = 0;
+    ntrip->gga_len = 0;
+    ntrip->gga_off = 0;
+    ntrip->gga_now = 0;
 
     return tcpcli_init(&ntrip->tcp, conn_timeout, inact_timeout, reconn_wait);
 }
 
+// serialize request of current settings, sent on each connection.
+// return -1 in error, 0 in success.
+static int ntripcli_build_request(struct ntripcli *ntrip)
+{
+    const char *headers = ntrip->headers ? ntrip->headers : "";
+    int source = ntrip->push && ntrip->version == 1;
+    // default agent unless given by header
+    char agent[96];
+    snprintf(agent, sizeof(agent), "%s NTRIP https://github.com/lazytinker/wsocket\r\n",
+             source ? "Source-Agent:" : "User-Agent:");
+    for (const char *line = headers; *line; line = strchr(line, '\n') + 1) {
+        if (match_prefix(line, source ? "Source-Agent:" : "User-Agent:")) {
+            agent[0] = '\0';
+        }
+    }
+    char start[128];
+    char host[160] = "";
+    char auth[96] = "";
+    const char *tail = "";
+    if (source) {
+        // version 1 source sends password only
+        snprintf(start, sizeof(start), "SOURCE %s /%s\r\n", ntrip->passwd, ntrip->mnt);
+    } else {
+        snprintf(start, sizeof(start), "%s /%s HTTP/1.%d\r\n",
+                 ntrip->push ? "POST" : "GET", ntrip->mnt, ntrip->version == 2 ? 1 : 0);
+        snprintf(auth, sizeof(auth), "Authorization: Basic %s\r\n", ntrip->token_cache);
+    }
+    if (ntrip->version == 2) {
+        snprintf(host, sizeof(host), "Host: %s:%s\r\nNtrip-Version: Ntrip/2.0\r\n",
+                 ntrip->tcp.addr, ntrip->tcp.serv);
+        tail = ntrip->push ? "Content-Type: gnss/data\r\nTransfer-Encoding: chunked\r\n"
+                           : "Connection: close\r\n";
+    }
+    // first GGA goes with request
+    char gga_hdr[NTRIPCLI_GGA_MAX + 16] = "";
+    const char *gga = "";
+    if (ntrip->gga_on && !ntrip->push && ntripcli_make_gga(ntrip, wtime_now()) == 0) {
+        if (ntrip->version == 2) {
+            snprintf(gga_hdr, sizeof(gga_hdr), "Ntrip-GGA: %s", ntrip->gga);
+        } else {
+            gga = ntrip->gga;
+        }
+        // sent already
+        ntrip->gga_off = ntrip->gga_len;
+        ntrip->gga_now = 0;
+    }
+    const char *fmt = "%s%s%s%s%s%s%s\r\n%s";
+    int len = snprintf(NULL, 0, fmt, start, host, agent, auth, headers, gga_hdr, tail, gga);
+    if (len < 0) {
+        return -1;
+    }
+    char *req = malloc(len + 1);
+    if (req == NULL) {
+        return -1;
+    }
+    snprintf(req, len + 1, fmt, start, host, agent, auth, headers, gga_hdr, tail, gga);
+    free(ntrip->req);
+    ntrip->req = req;
+    ntrip->req_len = len;
+    ntrip->req_dirty = 0;
+    return 0;
+}
+
+// settings of request changed. request being sent is kept, it is rebuilt
+// before next connection sends it.
+static void ntripcli_request_changed(struct ntripcli *ntrip)
+{
+    if (ntrip->step != STEP_NEW) {
+        ntrip->req_dirty = 1;
+    }
+}
+
+int ntripcli_set_header(struct ntripcli *ntrip, const char *name, const char *value)
+{
+    size_t nlen = strlen(name);
+    if (nlen == 0 || strpbrk(name, ":\r\n") || (value && strpbrk(value, "\r\n"))) {
+        return -1;
+    }
+    // remove header of same name
+    char *line = ntrip->headers;
+    while (line && *line) {
+        char *next = strchr(line, '\n') + 1;
+        if (match_prefix(line, name) && line[nlen] == ':') {
+            memmove(line, next, ntrip->headers + ntrip->headers_len + 1 - next);
+            ntrip->headers_len -= next - line;
+        } else {
+            line = next;
+        }
+    }
+    if (value) {
+        size_t add = nlen + strlen(value) + 4;
+        char *headers = realloc(ntrip->headers, ntrip->headers_len + add + 1);
+        if (headers == NULL) {
+            return -1;
+        }
+        snprintf(headers + ntrip->headers_len, add + 1, "%s: %s\r\n", name, value);
+        ntrip->headers = headers;
+        ntrip->headers_len += add;
+    }
+    ntripcli_request_changed(ntrip);
+    return 0;
+}
+
 int ntripcli_open(struct ntripcli *ntrip,
                   const char *addr, int port,
                   const char *user, const char *passwd,
@@ -101,12 +392,19 @@ int ntripcli_open(struct ntripcli *ntrip,
     if (base64_encode(token, strlen(token), ntrip->token_cache, sizeof(ntrip->token_cache)) == NULL) {
         return -1;
     }
+    // drop line feed added by encoder
+    ntrip->token_cache[strcspn(ntrip->token_cache, "\n")] = '\0';
     snprintf(ntrip->path_cache, sizeof(ntrip->path_cache), "%s:%s@%s:%d/%s",
              user, passwd, addr, port, mnt);
     int rv = tcpcli_open(&ntrip->tcp, addr, port);
     if (rv == -1) {
         return -1;
     }
+    if (ntripcli_build_request(ntrip) == -1) {
+        tcpcli_close(&ntrip->tcp);
+        return -1;
+    }
+    ntrip->req_off = 0;
     ntrip->step = STEP_CONN;
     return 0;
 }
@@ -144,6 +442,84 @@ int ntripcli_open_path(struct ntripcli *ntrip, const char *path)
 }
 
 
+int ntripcli_set_version(struct ntripcli *ntrip, int version)
+{
+    if (version != 1 && version != 2) {
+        return -1;
+    }
+    ntrip->version = version;
+    ntripcli_request_changed(ntrip);
+    return 0;
+}
+
+// handle one response line without line end.
+// return 1 if header ends, 0 if more lines expected, -1 if rejected.
+static int ntripcli_parse_line(struct ntripcli *ntrip, char *line)
+{
+    if (ntrip->hdr_state == HDR_STATUS) {
+        if (strcmp(line, "ICY 200 OK") == 0) {
+            // version 1, data follows status line
+            return 1;
+        }
+        if (ntrip->table && strcmp(line, "SOURCETABLE 200 OK") == 0) {
+            // version 1 sourcetable, header fields follow
+            ntrip->hdr_state = HDR_FIELDS;
+            return 0;
+        }
+        // version 2, HTTP status line and headers. others such as
+        // SOURCETABLE mean mountpoint is not available.
+        char *code = strchr(line, ' ');
+        if (strncmp(line, "HTTP/1.", 7) != 0 || code == NULL || atoi(code + 1) != 200) {
+            return -1;
+        }
+        ntrip->hdr_state = HDR_FIELDS;
+        return 0;
+    }
+    if (line[0] == '\0') {
+        return 1;
+    }
+    if (match_prefix(line, "Transfer-Encoding:")) {
+        for (char *p = line + 18; *p; p++) {
+            if (match_prefix(p, "chunked")) {
+                ntrip->chunked = 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// parse response header from received bytes in cache[from, cache_idx).
+// parsed lines are dropped from cache, payload after header is kept in cache
+// from cache_off.
+// return 1 if accepted, 0 if incomplete, -1 if rejected.
+static int ntripcli_parse_header(struct ntripcli *ntrip, size_t from)
+{
+    char *cache = (char *)ntrip->cache;
+    size_t line = 0;
+    int rv = 0;
+    while (rv == 0) {
+        char *lf = memchr(cache + from, '\n', ntrip->cache_idx - from);
+        if (lf == NULL) {
+            break;
+        }
+        from = lf + 1 - cache;
+        if (lf > cache + line && lf[-1] == '\r') {
+            lf--;
+        }
+        *lf = '\0';
+        rv = ntripcli_parse_line(ntrip, cache + line);
+        line = from;
+    }
+    if (rv == 1) {
+        ntrip->cache_off = from;
+    } else if (rv == 0 && line > 0) {
+        // keep incomplete line only
+        memmove(cache, cache + line, ntrip->cache_idx - line);
+        ntrip->cache_idx -= line;
+    }
+    return rv;
+}
+
 // return: -1 = error, 0 = wait, 1 = ok
 static int ntripcli_wait(struct ntripcli *ntrip)
 {
@@ -152,52 +528,385 @@ static int ntripcli_wait(struct ntripcli *ntrip)
     }
     if (!tcpcli_isconnected(&ntrip->tcp)) {
         ntrip->step = STEP_CONN;
-        ntrip->cache[0] = '\0';
+        ntrip->req_off = 0;
+        // message in flight is sent again from its start
+        ntrip->out_sent = 0;
+        // GGA in flight is dropped, next one goes with request
+        ntrip->gga_off = ntrip->gga_len;
         ntrip->cache_idx = 0;
+        ntrip->cache_off = 0;
+    }
+    int64_t now = wtime_now();
+    int64_t gga_interval = ntrip->gga_interval > 0 ? ntrip->gga_interval : WTIME_NS_PER_SEC;
+    if (ntrip->step == STEP_CONN && ntrip->req_off == 0) {
+        // nothing sent yet, apply changed settings. refresh GGA in request,
+        // at most once per interval while connecting
+        if (ntrip->req_dirty || (ntrip->gga_on && !ntrip->push &&
+                                 now - ntrip->gga_time >= gga_interval)) {
+            if (ntripcli_build_request(ntrip) == -1) {
+                return -1;
+            }
+        }
     }
     if (ntrip->step == STEP_CONN) {
-        char buf[256];
-        snprintf(buf, sizeof(buf),
-                 "GET /%s HTTP/1.0\r\n"
-                 "User-Agent: https://github.com/lazytinker/wsocket\r\n"
-                 "Authorization: Basic %s\r\n"
-                 "\r\n",
-                 ntrip->mnt, ntrip->token_cache);
-        int rv = tcpcli_write(&ntrip->tcp, buf, strlen(buf));
+        // resume partial request
+        int rv = tcpcli_write(&ntrip->tcp, ntrip->req + ntrip->req_off,
+                              ntrip->req_len - ntrip->req_off);
         if (rv == -1) {
             return -1;
         }
-        if (rv == strlen(buf)) {
+        ntrip->req_off += rv;
+        if (ntrip->req_off == ntrip->req_len) {
             ntrip->step = STEP_EXPECT;
+            ntrip->hdr_state = HDR_STATUS;
+            ntrip->chunked = 0;
+            ntrip->cache_idx = 0;
+            ntrip->cache_off = 0;
         }
     }
     if (ntrip->step == STEP_EXPECT) {
+        size_t from = ntrip->cache_idx;
         int rd = tcpcli_read(&ntrip->tcp,
                              ntrip->cache + ntrip->cache_idx,
-                             sizeof(ntrip->cache) - ntrip->cache_idx - 1);
+                             sizeof(ntrip->cache) - ntrip->cache_idx);
         if (rd == -1) {
             return -1;
         }
         if (rd > 0) {
             ntrip->cache_idx += rd;
-            ntrip->cache[ntrip->cache_idx] = '\0';
-            if (strstr(ntrip->cache, "ICY 200 OK\r\n")) {
+            int rv = ntripcli_parse_header(ntrip, from);
+            if (rv == 1) {
                 ntrip->step = STEP_DONE;
-                ntrip->cache[0] = '\0';
-                ntrip->cache_idx = 0;
-            } else if (strstr(ntrip->cache, "HTTP/")){
-                ntrip->step = STEP_CONN;
-            } else if (ntrip->cache_idx >= sizeof(ntrip->cache)) {
+                ntrip->chunk_state = CHUNK_SIZE;
+                ntrip->chunk_digits = 0;
+                ntrip->chunk_size = 0;
+                if (ntrip->rtcm) {
+                    rtcm3_reset(ntrip->rtcm);
+                }
+                if (ntrip->table) {
+                    sourcetable_reset(ntrip->table);
+                }
+            } else if (rv == -1 || ntrip->cache_idx == sizeof(ntrip->cache)) {
+                // rejected or header line too long, reconnect later
+                tcpcli_reset(&ntrip->tcp);
                 ntrip->step = STEP_CONN;
             }
         }
     }
+    if (ntrip->step == STEP_DONE && !ntrip->push) {
+        // GGA being sent is finished even if GGA source changed
+        if (ntrip->gga_on && ntrip->gga_off == ntrip->gga_len &&
+            (ntrip->gga_now || (ntrip->gga_interval > 0 && now - ntrip->gga_time >= ntrip->gga_interval))) {
+            ntrip->gga_now = 0;
+            ntripcli_make_gga(ntrip, now);
+        }
+        if (ntrip->gga_off < ntrip->gga_len) {
+            int rv = tcpcli_write(&ntrip->tcp, ntrip->gga + ntrip->gga_off,
+                                  ntrip->gga_len - ntrip->gga_off);
+            if (rv == -1) {
+                return -1;
+            }
+            ntrip->gga_off += rv;
+        }
+    }
     if (ntrip->step == STEP_DONE) {
         return 1;
     }
     return 0;
 }
 
+// decode chunked data in place, payload is moved to front of p.
+// connection is reset on malformed data or last chunk.
+// return payload bytes count.
+static int ntripcli_dechunk(struct ntripcli *ntrip, unsigned char *p, size_t n)
+{
+    size_t out = 0;
+    size_t i = 0;
+    while (i < n) {
+        unsigned char c = p[i];
+        int bad = 0;
+        int line_end = 0;
+        switch (ntrip->chunk_state) {
+        case CHUNK_SIZE:
+            if (hex_value(c) >= 0) {
+                if (ntrip->chunk_size > (SIZE_MAX >> 4)) {
+                    bad = 1;
+                }
+                ntrip->chunk_size = (ntrip->chunk_size << 4) | hex_value(c);
+                ntrip->chunk_digits++;
+            } else if (ntrip->chunk_digits == 0) {
+                bad = 1;
+            } else if (c == '\r') {
+                ntrip->chunk_state = CHUNK_SIZE_LF;
+            } else if (c == '\n') {
+                line_end = 1;
+            } else if (c == ';' || c == ' ' || c == '\t') {
+                ntrip->chunk_state = CHUNK_EXT;
+            } else {
+                bad = 1;
+            }
+            i++;
+            break;
+        case CHUNK_EXT:
+            line_end = (c == '\n');
+            i++;
+            break;
+        case CHUNK_SIZE_LF:
+            line_end = (c == '\n');
+            bad = !line_end;
+            i++;
+            break;
+        case CHUNK_DATA: {
+            size_t take = n - i < ntrip->chunk_size ? n - i : ntrip->chunk_size;
+            memmove(p + out, p + i, take);
+            out += take;
+            i += take;
+            ntrip->chunk_size -= take;
+            if (ntrip->chunk_size == 0) {
+                ntrip->chunk_state = CHUNK_DATA_CR;
+            }
+            break;
+        }
+        case CHUNK_DATA_CR:
+        case CHUNK_DATA_LF:
+            if (c == '\r' && ntrip->chunk_state == CHUNK_DATA_CR) {
+                ntrip->chunk_state = CHUNK_DATA_LF;
+            } else if (c == '\n') {
+                ntrip->chunk_state = CHUNK_SIZE;
+                ntrip->chunk_digits = 0;
+            } else {
+                bad = 1;
+            }
+            i++;
+            break;
+        }
+        if (line_end) {
+            // last chunk means stream ended
+            bad = ntrip->chunk_size == 0;
+            ntrip->chunk_state = CHUNK_DATA;
+        }
+        if (bad) {
+            tcpcli_reset(&ntrip->tcp);
+            break;
+        }
+    }
+    return out;
+}
+
+// read stream data, payload received with header first.
+// return bytes count, -1 in error.
+static int ntripcli_read_payload(struct ntripcli *ntrip, void *buff, size_t count)
+{
+    int rd = 0;
+    if (ntrip->cache_off < ntrip->cache_idx) {
+        size_t n = ntrip->cache_idx - ntrip->cache_off;
+        if (n > count) {
+            n = count;
+        }
+        memcpy(buff, ntrip->cache + ntrip->cache_off, n);
+        ntrip->cache_off += n;
+        if (ntrip->cache_off == ntrip->cache_idx) {
+            ntrip->cache_off = 0;
+            ntrip->cache_idx = 0;
+        }
+        rd = n;
+    } else {
+        rd = tcpcli_read(&ntrip->tcp, buff, count);
+    }
+    if (rd > 0 && ntrip->chunked) {
+        rd = ntripcli_dechunk(ntrip, buff, rd);
+    }
+    return rd;
+}
+
+// free push queue
+static void ntripcli_free_queue(struct ntripcli *ntrip)
+{
+    wring_free(&ntrip->outq);
+    free(ntrip->out_msgs);
+    ntrip->out_msgs = NULL;
+    ntrip->out_cap = 0;
+    ntrip->out_head = 0;
+    ntrip->out_count = 0;
+    ntrip->out_sent = 0;
+}
+
+int ntripcli_set_push(struct ntripcli *ntrip, size_t queue_size)
+{
+    ntripcli_free_queue(ntrip);
+    ntrip->push = 0;
+    if (queue_size > 0) {
+        if (wring_init(&ntrip->outq, queue_size) == -1) {
+            return -1;
+        }
+        ntrip->push = 1;
+    }
+    ntripcli_request_changed(ntrip);
+    return 0;
+}
+
+// drop head message of push queue
+static void ntripcli_pop_msg(struct ntripcli *ntrip)
+{
+    wring_consume(&ntrip->outq, ntrip->out_msgs[ntrip->out_head]);
+    ntrip->out_head = (ntrip->out_head + 1) & (ntrip->out_cap - 1);
+    ntrip->out_count--;
+}
+
+// drop message after the head one which is partly sent, the whole head one
+// is moved over it, as it is sent again from its start on reconnection.
+static void ntripcli_drop_next_msg(struct ntripcli *ntrip)
+{
+    int mask = ntrip->out_cap - 1;
+    int next = (ntrip->out_head + 1) & mask;
+    size_t first = ntrip->out_msgs[ntrip->out_head];
+    size_t second = ntrip->out_msgs[next];
+    size_t len = 0;
+    char *p = (char *)wring_peek(&ntrip->outq, &len);
+    memmove(p + second, p, first);
+    wring_consume(&ntrip->outq, second);
+    ntrip->out_msgs[next] = first;
+    ntrip->out_head = next;
+    ntrip->out_count--;
+}
+
+// queue message, as one chunk in version 2. oldest whole messages are dropped
+// when queue is full, the one in flight is kept.
+// return 0 on success, -1 if no room.
+static int ntripcli_enqueue(struct ntripcli *ntrip, const void *data, size_t count)
+{
+    char head[24] = "";
+    const char *trail = "";
+    if (ntrip->version == 2) {
+        snprintf(head, sizeof(head), "%zx\r\n", count);
+        trail = "\r\n";
+    }
+    size_t need = strlen(head) + count + strlen(trail);
+    struct wring *q = &ntrip->outq;
+    while (q->size - q->len < need && ntrip->out_count > 0) {
+        if (ntrip->out_sent == 0) {
+            ntripcli_pop_msg(ntrip);
+        } else if (ntrip->out_count > 1) {
+            ntripcli_drop_next_msg(ntrip);
+        } else {
+            break;
+        }
+        ntrip->out_dropped++;
+    }
+    if (q->size - q->len < need) {
+        ntrip->out_dropped++;
+        return -1;
+    }
+    if (ntrip->out_count == ntrip->out_cap) {
+        int cap = ntrip->out_cap ? ntrip->out_cap * 2 : 16;
+        size_t *msgs = malloc(cap * sizeof(*msgs));
+        if (msgs == NULL) {
+            return -1;
+        }
+        for (int i = 0; i < ntrip->out_count; i++) {
+            msgs[i] = ntrip->out_msgs[(ntrip->out_head + i) & (ntrip->out_cap - 1)];
+        }
+        free(ntrip->out_msgs);
+        ntrip->out_msgs = msgs;
+        ntrip->out_cap = cap;
+        ntrip->out_head = 0;
+    }
+    ntrip->out_msgs[(ntrip->out_head + ntrip->out_count) & (ntrip->out_cap - 1)] = need;
+    ntrip->out_count++;
+    const char *parts[3] = {head, data, trail};
+    size_t lens[3] = {strlen(head), count, strlen(trail)};
+    for (int i = 0; i < 3; i++) {
+        const char *p = parts[i];
+        size_t n = lens[i];
+        while (n > 0) {
+            // free space may come in two pieces without mirrored mapping
+            size_t avail = 0;
+            char *w = wring_write_ptr(q, &avail);
+            size_t take = avail < n ? avail : n;
+            memcpy(w, p, take);
+            wring_commit(q, take);
+            p += take;
+            n -= take;
+        }
+    }
+    return 0;
+}
+
+// send queued messages in one write.
+// return queued bytes left, -1 in error.
+static int ntripcli_send_queue(struct ntripcli *ntrip)
+{
+    size_t len = 0;
+    const char *p = wring_peek(&ntrip->outq, &len);
+    if (ntrip->out_sent < len) {
+        int rv = tcpcli_write(&ntrip->tcp, p + ntrip->out_sent, len - ntrip->out_sent);
+        if (rv == -1) {
+            return -1;
+        }
+        ntrip->out_sent += rv;
+    }
+    while (ntrip->out_count > 0 && ntrip->out_sent >= ntrip->out_msgs[ntrip->out_head]) {
+        ntrip->out_sent -= ntrip->out_msgs[ntrip->out_head];
+        ntripcli_pop_msg(ntrip);
+    }
+    return ntrip->outq.len;
+}
+
+int ntripcli_flush(struct ntripcli *ntrip)
+{
+    if (!ntrip->push) {
+        return -1;
+    }
+    int rv = ntripcli_wait(ntrip);
+    if (rv < 0) {
+        return -1;
+    }
+    if (rv == 1) {
+        // nothing is expected from caster, read to detect disconnection
+        char buf[256];
+        if (tcpcli_read(&ntrip->tcp, buf, sizeof(buf)) == -1) {
+            return -1;
+        }
+        return ntripcli_send_queue(ntrip);
+    }
+    return ntrip->outq.len;
+}
+
+// restart GGA schedule with new source
+static void ntripcli_gga_reset(struct ntripcli *ntrip, int on, ntripcli_gga_cb cb, void *arg,
+                               double interval)
+{
+    ntrip->gga_on = on;
+    ntrip->gga_cb = cb;
+    ntrip->gga_arg = arg;
+    ntrip->gga_interval = interval > 0 ? WTIME_FROM_SEC(interval) : 0;
+    ntripcli_request_changed(ntrip);
+    // streaming already, send new GGA after the one being sent, if any
+    ntrip->gga_now = on && ntrip->step == STEP_DONE;
+}
+
+int ntripcli_set_gga(struct ntripcli *ntrip, double lat, double lon, double alt,
+                     double interval)
+{
+    if (!gga_valid(lat, lon, alt)) {
+        return -1;
+    }
+    ntrip->gga_lat = lat;
+    ntrip->gga_lon = lon;
+    ntrip->gga_alt = alt;
+    int64_t iv = interval > 0 ? WTIME_FROM_SEC(interval) : 0;
+    if (!ntrip->gga_on || ntrip->gga_cb || ntrip->gga_interval != iv) {
+        ntripcli_gga_reset(ntrip, 1, NULL, NULL, interval);
+    }
+    // otherwise only position changes, schedule is kept
+    return 0;
+}
+
+void ntripcli_set_gga_cb(struct ntripcli *ntrip, ntripcli_gga_cb cb, void *arg,
+                         double interval)
+{
+    ntripcli_gga_reset(ntrip, cb != NULL, cb, arg, interval);
+}
 
 int ntripcli_read(struct ntripcli *ntrip, void *buff, size_t count)
 {
@@ -207,12 +916,86 @@ int ntripcli_read(struct ntripcli *ntrip, void *buff, size_t count)
     } else if (rv == 0) {
         return 0;
     } else {
-        return tcpcli_read(&ntrip->tcp, buff, count);
+        rv = ntripcli_read_payload(ntrip, buff, count);
+        if (rv > 0 && ntrip->rtcm) {
+            rtcm3_input(ntrip->rtcm, buff, rv);
+        }
+        return rv;
+    }
+}
+
+void ntripcli_set_rtcm3(struct ntripcli *ntrip, struct rtcm3_framer *framer)
+{
+    ntrip->rtcm = framer;
+}
+
+int ntripcli_read_rtcm3(struct ntripcli *ntrip)
+{
+    if (ntrip->rtcm == NULL) {
+        return -1;
+    }
+    int rv = ntripcli_wait(ntrip);
+    if (rv <= 0) {
+        return rv;
     }
+    if (ntrip->tcp.rx.buf && !ntrip->chunked && ntrip->cache_off >= ntrip->cache_idx) {
+        const void *ptr = NULL;
+        size_t len = 0;
+        if (tcpcli_peek(&ntrip->tcp, &ptr, &len) == -1) {
+            return -1;
+        }
+        int cnt = rtcm3_input(ntrip->rtcm, ptr, len);
+        tcpcli_consume(&ntrip->tcp, len);
+        return cnt;
+    }
+    unsigned char buf[4096];
+    int rd = ntripcli_read_payload(ntrip, buf, sizeof(buf));
+    if (rd == -1) {
+        return -1;
+    }
+    return rtcm3_input(ntrip->rtcm, buf, rd);
+}
+
+void ntripcli_set_table(struct ntripcli *ntrip, struct sourcetable *table)
+{
+    ntrip->table = table;
+}
+
+int ntripcli_read_table(struct ntripcli *ntrip)
+{
+    if (ntrip->table == NULL) {
+        return -1;
+    }
+    if (ntrip->table->done) {
+        return 1;
+    }
+    int rv = ntripcli_wait(ntrip);
+    if (rv <= 0) {
+        return rv;
+    }
+    char buf[4096];
+    int rd = 0;
+    while ((rd = ntripcli_read_payload(ntrip, buf, sizeof(buf))) > 0) {
+        rv = sourcetable_input(ntrip->table, buf, rd);
+        if (rv != 0) {
+            return rv;
+        }
+    }
+    return rd == -1 ? -1 : 0;
 }
 
 int ntripcli_write(struct ntripcli *ntrip, const void *data, size_t count)
 {
+    if (ntrip->push) {
+        if (ntrip->step == STEP_NEW) {
+            return -1;
+        }
+        int queued = ntripcli_enqueue(ntrip, data, count) == 0;
+        if (ntripcli_flush(ntrip) == -1) {
+            return -1;
+        }
+        return queued ? (int)count : 0;
+    }
     int rv = ntripcli_wait(ntrip);
     if (rv < 0) {
         return -1;
@@ -227,6 +1010,11 @@ int ntripcli_close(struct ntripcli *ntrip)
 {
 
     if (ntrip) {
+        if (ntrip->push && ntrip->version == 2 && ntrip->step == STEP_DONE &&
+            ntrip->out_sent == 0 && tcpcli_isconnected(&ntrip->tcp)) {
+            // last chunk ends the stream, unless a chunk is partially sent
+            tcpcli_write(&ntrip->tcp, "0\r\n\r\n", 5);
+        }
         tcpcli_close(&ntrip->tcp);
         ntrip->user[0] = '\0';
         ntrip->passwd[0] = '\0';
@@ -235,7 +1023,17 @@ int ntripcli_close(struct ntripcli *ntrip)
         ntrip->step = STEP_NEW;
         ntrip->cache[0] = '\0';
         ntrip->cache_idx = 0;
+        ntrip->cache_off = 0;
         ntrip->path_cache[0] = '\0';
+        free(ntrip->headers);
+        ntrip->headers = NULL;
+        ntrip->headers_len = 0;
+        free(ntrip->req);
+        ntrip->req = NULL;
+        ntripcli_free_queue(ntrip);
+        ntrip->push = 0;
+        ntrip->req_len = 0;
+        ntrip->req_off = 0;
     }
     return 0;
 }
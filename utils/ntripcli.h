@@ -2,11 +2,26 @@
 #define NTRIPCLI_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <time.h>
 #include "tcpcli.h"
+#include "rtcm3.h"
+#include "wring.h"
+#include "sourcetable.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// max length of GGA sentence, with line end and terminator
+#define NTRIPCLI_GGA_MAX    96
+
+struct ntripcli;
+
+// get rover position for GGA, latitude and longitude in degrees, altitude in
+// meters. return 0 on success, -1 if position is not available.
+typedef int (*ntripcli_gga_cb)(struct ntripcli *ntrip, double *lat, double *lon,
+                               double *alt, void *arg);
+
 struct ntripcli {
     struct tcpcli tcp;
 
@@ -17,8 +32,49 @@ struct ntripcli {
     char token_cache[64];
     char path_cache[256];
 
-    unsigned char cache[512];
+    char *headers;      // extra request header lines, see ntripcli_set_header
+    size_t headers_len;
+    char *req;          // request serialized in ntripcli_open
+    size_t req_len;
+    size_t req_off;     // bytes of request sent on current connection
+    int req_dirty;      // settings changed, request is rebuilt on next connection
+
+    int version;        // NTRIP version, 1 or 2, see ntripcli_set_version
+    int hdr_state;      // response header parsing state
+    int chunked;        // response uses chunked transfer encoding
+    int chunk_state;
+    int chunk_digits;   // hex digits of chunk size line
+    size_t chunk_size;  // size of current chunk, then its remaining bytes
+
+    unsigned char cache[512]; // incomplete line of response header, then
+                              // payload received with it
     size_t cache_idx;
+    size_t cache_off;   // payload is kept from cache_off to cache_idx
+
+    struct rtcm3_framer *rtcm; // attached framer, NULL if none
+    struct sourcetable *table; // attached sourcetable, NULL if none
+
+    int push;           // push mode, see ntripcli_set_push
+    struct wring outq;  // queued messages to caster
+    size_t *out_msgs;   // ring of queued messages length
+    int out_cap;        // power of 2
+    int out_head;
+    int out_count;
+    size_t out_sent;    // bytes of queue sent on current connection
+    size_t out_dropped; // messages dropped as queue is full
+
+    int gga_on;         // GGA is sent, see ntripcli_set_gga
+    double gga_lat;     // position given by ntripcli_set_gga
+    double gga_lon;
+    double gga_alt;
+    ntripcli_gga_cb gga_cb; // position callback, NULL to use fixed position
+    void *gga_arg;
+    int64_t gga_interval;   // nanoseconds, 0 means only with request
+    int64_t gga_time;       // time of last GGA, see wtime.h
+    char gga[NTRIPCLI_GGA_MAX]; // GGA sentence being sent
+    size_t gga_len;
+    size_t gga_off;
+    int gga_now;        // send a GGA once current one is sent, source changed
 };
 
 
@@ -42,14 +98,88 @@ int ntripcli_open(struct ntripcli *ntrip,
 int ntripcli_open_path(struct ntripcli *ntrip, const char *path);
 
 
+// set NTRIP version of request, 1 (default) or 2. version 2 sends HTTP/1.1
+// request with Ntrip-Version header and accepts chunked response, it takes
+// effect from next connection.
+// return 0 on success, -1 if version is not supported.
+int ntripcli_set_version(struct ntripcli *ntrip, int version);
+
+// set extra request header, replace header of same name, NULL value to
+// remove. a User-Agent header replaces default one. it takes effect from next
+// connection.
+// return 0 on success, -1 in error or name/value contains line break.
+int ntripcli_set_header(struct ntripcli *ntrip, const char *name, const char *value);
+
+// set push mode to send data to caster as a source, queue_size is bytes of
+// messages queued for sending, 0 to disable push mode.
+// version 1 sends "SOURCE passwd /mnt", user is ignored. version 2 sends POST
+// with Basic auth and each message is sent as one chunk.
+// it takes effect from next connection, call it before ntripcli_write.
+// return 0 on success, -1 in error.
+int ntripcli_set_push(struct ntripcli *ntrip, size_t queue_size);
+
+// send queued messages in push mode, ntripcli_write does it too. call it
+// periodically to send queued messages while there is nothing to write.
+// inact_timeout applies to data received, so it should be 0 if caster sends
+// nothing back.
+// return bytes still queued, -1 in error or not in push mode.
+// reconnect behavior is same as ntripcli_read.
+int ntripcli_flush(struct ntripcli *ntrip);
+
+// send GGA of fixed position every interval seconds, interval <= 0 means only
+// with request. first GGA is sent with request, as Ntrip-GGA header in version
+// 2 or after request in version 1, so caster starts streaming at once.
+// not used in push mode. if GGA source or interval changes while streaming, a
+// new GGA is sent after the one being sent.
+// return 0 on success, -1 if position is invalid.
+int ntripcli_set_gga(struct ntripcli *ntrip, double lat, double lon, double alt,
+                     double interval);
+
+// same as ntripcli_set_gga, position is got from cb when GGA is sent.
+// cb NULL disables GGA.
+void ntripcli_set_gga_cb(struct ntripcli *ntrip, ntripcli_gga_cb cb, void *arg,
+                         double interval);
+
+// format GGA sentence with line end at UTC time t into buf of at least
+// NTRIPCLI_GGA_MAX bytes, fix quality is 1.
+// return length, -1 if position is invalid.
+int ntripcli_format_gga(char *buf, double lat, double lon, double alt, time_t t);
+
 // read data from ntripcli object, in non-blocking mode.
 // return -1 in error, otherwise return bytes count has read.
+// only stream data is returned, chunked transfer encoding is removed.
 // it will auto reconnect in connection error and not return -1 if reconn_wait >= 0.
 // if reconn_wait < 0, it will return -1 either connection error or in waiting.
 int ntripcli_read(struct ntripcli *ntrip, void *buff, size_t count);
 
+// attach RTCM3 framer, NULL to detach. data returned by ntripcli_read is also
+// passed to framer, and framer is reset when a new stream starts.
+void ntripcli_set_rtcm3(struct ntripcli *ntrip, struct rtcm3_framer *framer);
+
+// read available data into attached framer, messages are passed to its
+// callback. if receive ring of ntrip->tcp is enabled by tcpcli_set_rxring,
+// messages are framed in place without copy.
+// return -1 in error or no framer attached, otherwise messages count.
+// reconnect behavior is same as ntripcli_read.
+int ntripcli_read_rtcm3(struct ntripcli *ntrip);
+
+// attach sourcetable, NULL to detach. with it, ntripcli accepts sourcetable
+// response, open with empty mnt to request it. table is reset when a new
+// response starts.
+void ntripcli_set_table(struct ntripcli *ntrip, struct sourcetable *table);
+
+// read sourcetable response into attached table, records are parsed as data
+// arrives, the body is not buffered.
+// return 1 if complete, 0 if in progress, -1 in error or no table attached.
+// connection is kept after complete, close it when done.
+// reconnect behavior is same as ntripcli_read.
+int ntripcli_read_table(struct ntripcli *ntrip);
+
 // write data to ntripcli object, in non-blocking mode.
 // return -1 in error ,otherwise return bytes count has written.
+// in push mode data is queued as one message and queued messages are sent
+// together. a message partially sent when connection breaks is sent again
+// from its start after reconnect. return count if queued, 0 if queue is full.
 // it will auto reconnect in connection error and not return -1 if reconn_wait >= 0.
 // if reconn_wait < 0, it will return -1 either connection error or in waiting.
 int ntripcli_write(struct ntripcli *ntrip, const void *data, size_t count);
@@ -0,0 +1,609 @@
+#include "ntripsvr.h"
+#include "wtime.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+// request parsing state of client
+enum ConnState {
+    CONN_REQUEST,   // request line
+    CONN_HEADER,    // header fields
+    CONN_STREAM,    // subscribed to mountpoint
+    CONN_DONE,      // response sent, closing
+};
+
+static const char m_stream_v1[] = "ICY 200 OK\r\n";
+static const char m_stream_v2[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Ntrip-Version: Ntrip/2.0\r\n"
+    "Server: NTRIP wsocket\r\n"
+    "Content-Type: gnss/data\r\n"
+    "Cache-Control: no-store, no-cache, max-age=0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+static const char m_unauthorized[] =
+    "HTTP/1.1 401 Unauthorized\r\n"
+    "Ntrip-Version: Ntrip/2.0\r\n"
+    "Server: NTRIP wsocket\r\n"
+    "WWW-Authenticate: Basic realm=\"NTRIP\"\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+static const char m_bad_request[] =
+    "HTTP/1.1 400 Bad Request\r\n"
+    "Server: NTRIP wsocket\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+static const char m_table_end[] = "ENDSOURCETABLE\r\n";
+
+static const char m_base64_table[65] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// encode src into buf without line feeds, return -1 if buf is not enough.
+static int base64_encode(const char *src, char *buf, size_t buf_len)
+{
+    const unsigned char *in = (const unsigned char *)src;
+    size_t len = strlen(src);
+    if ((len + 2) / 3 * 4 + 1 > buf_len) {
+        return -1;
+    }
+    for (; len >= 3; len -= 3, in += 3) {
+        *buf++ = m_base64_table[in[0] >> 2];
+        *buf++ = m_base64_table[((in[0] & 0x03) << 4) | (in[1] >> 4)];
+        *buf++ = m_base64_table[((in[1] & 0x0f) << 2) | (in[2] >> 6)];
+        *buf++ = m_base64_table[in[2] & 0x3f];
+    }
+    if (len > 0) {
+        *buf++ = m_base64_table[in[0] >> 2];
+        if (len == 1) {
+            *buf++ = m_base64_table[(in[0] & 0x03) << 4];
+            *buf++ = '=';
+        } else {
+            *buf++ = m_base64_table[((in[0] & 0x03) << 4) | (in[1] >> 4)];
+            *buf++ = m_base64_table[(in[1] & 0x0f) << 2];
+        }
+        *buf++ = '=';
+    }
+    *buf = '\0';
+    return 0;
+}
+
+// case insensitive prefix match, return 1 if s starts with prefix.
+static int match_prefix(const char *s, const char *prefix)
+{
+    while (*prefix) {
+        if (tolower((unsigned char)*s++) != tolower((unsigned char)*prefix++)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// FNV-1a
+static unsigned int hash_str(const char *s)
+{
+    unsigned int h = 2166136261u;
+    while (*s) {
+        h = (h ^ (unsigned char)*s++) * 16777619u;
+    }
+    return h;
+}
+
+// find slot of key in hash table. slots hold item index + 1, key of item i is
+// the string at base + i * stride.
+// return slot of the item, or the empty slot to insert it.
+static int table_slot(const int *table, int slots, const char *base, size_t stride,
+                      const char *key)
+{
+    int i = hash_str(key) & (slots - 1);
+    while (table[i] && strcmp(base + (table[i] - 1) * stride, key) != 0) {
+        i = (i + 1) & (slots - 1);
+    }
+    return i;
+}
+
+// insert item n - 1 into hash table, table is rebuilt to keep load under half.
+// return 0 on success, -1 on no memory.
+static int table_insert(int **table, int *slots, const char *base, size_t stride, int n)
+{
+    if (*slots >= 2 * n) {
+        (*table)[table_slot(*table, *slots, base, stride, base + (n - 1) * stride)] = n;
+        return 0;
+    }
+    int cap = *slots ? *slots * 2 : 16;
+    int *t = calloc(cap, sizeof(*t));
+    if (t == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        t[table_slot(t, cap, base, stride, base + i * stride)] = i + 1;
+    }
+    free(*table);
+    *table = t;
+    *slots = cap;
+    return 0;
+}
+
+static void conn_reset(struct ntripsvr_conn *conn)
+{
+    conn->state = CONN_REQUEST;
+    conn->version = 1;
+    conn->mount = -1;
+    conn->authed = 0;
+    conn->prev = -1;
+    conn->next = -1;
+    conn->since = 0;
+    conn->len = 0;
+}
+
+// make conns cover client id, return 0 on success, -1 on no memory.
+static int ntripsvr_conn_grow(struct ntripsvr *svr, int id)
+{
+    if (id < svr->nconns) {
+        return 0;
+    }
+    int n = svr->tcp.cap > id ? svr->tcp.cap : id + 1;
+    struct ntripsvr_conn *conns = realloc(svr->conns, n * sizeof(*conns));
+    if (conns == NULL) {
+        return -1;
+    }
+    for (int i = svr->nconns; i < n; i++) {
+        conn_reset(&conns[i]);
+    }
+    svr->conns = conns;
+    svr->nconns = n;
+    return 0;
+}
+
+static void ntripsvr_subscribe(struct ntripsvr *svr, int id)
+{
+    struct ntripsvr_conn *conn = &svr->conns[id];
+    struct ntripsvr_mount *m = &svr->mounts[conn->mount];
+    conn->state = CONN_STREAM;
+    conn->prev = -1;
+    conn->next = m->head;
+    if (m->head != -1) {
+        svr->conns[m->head].prev = id;
+    }
+    m->head = id;
+    m->count++;
+}
+
+static void ntripsvr_unsubscribe(struct ntripsvr *svr, int id)
+{
+    struct ntripsvr_conn *conn = &svr->conns[id];
+    struct ntripsvr_mount *m = &svr->mounts[conn->mount];
+    if (conn->prev != -1) {
+        svr->conns[conn->prev].next = conn->next;
+    } else {
+        m->head = conn->next;
+    }
+    if (conn->next != -1) {
+        svr->conns[conn->next].prev = conn->prev;
+    }
+    m->count--;
+}
+
+static void ntripsvr_on_close(struct tcpsvr *tcp, int id, void *arg)
+{
+    (void)tcp;
+    struct ntripsvr *svr = arg;
+    if (id >= svr->nconns) {
+        return;
+    }
+    if (svr->conns[id].state == CONN_STREAM) {
+        ntripsvr_unsubscribe(svr, id);
+    }
+    conn_reset(&svr->conns[id]);
+}
+
+int ntripsvr_init(struct ntripsvr *svr, int max_cli)
+{
+    svr->conns = NULL;
+    svr->nconns = 0;
+    svr->mounts = NULL;
+    svr->nmounts = 0;
+    svr->mounts_cap = 0;
+    svr->mount_table = NULL;
+    svr->mount_slots = 0;
+    svr->users = NULL;
+    svr->nusers = 0;
+    svr->users_cap = 0;
+    svr->user_table = NULL;
+    svr->user_slots = 0;
+    svr->table = NULL;
+    svr->request_timeout = WTIME_FROM_SEC(NTRIPSVR_REQUEST_TIMEOUT);
+    svr->check_time = 0;
+    tcpsvr_init(&svr->tcp, TCPSVR_READ_NONE, max_cli);
+    tcpsvr_set_close_cb(&svr->tcp, ntripsvr_on_close, svr);
+    return 0;
+}
+
+int ntripsvr_open(struct ntripsvr *svr, const char *addr, int port,
+                  const struct tcpsvr_opts *opts)
+{
+    return tcpsvr_open_opts(&svr->tcp, addr, port, opts);
+}
+
+int ntripsvr_add_user(struct ntripsvr *svr, const char *user, const char *passwd)
+{
+    char cred[64];
+    char token[64];
+    if (snprintf(cred, sizeof(cred), "%s:%s", user, passwd) >= (int)sizeof(cred) ||
+        base64_encode(cred, token, sizeof(token)) == -1) {
+        return -1;
+    }
+    if (svr->nusers > 0 &&
+        svr->user_table[table_slot(svr->user_table, svr->user_slots,
+                                   (const char *)svr->users, sizeof(*svr->users), token)]) {
+        return 0;
+    }
+    if (svr->nusers == svr->users_cap) {
+        int cap = svr->users_cap ? svr->users_cap * 2 : 16;
+        char (*users)[64] = realloc(svr->users, cap * sizeof(*users));
+        if (users == NULL) {
+            return -1;
+        }
+        svr->users = users;
+        svr->users_cap = cap;
+    }
+    memcpy(svr->users[svr->nusers], token, sizeof(token));
+    if (table_insert(&svr->user_table, &svr->user_slots,
+                     (const char *)svr->users, sizeof(*svr->users), svr->nusers + 1) == -1) {
+        return -1;
+    }
+    svr->nusers++;
+    if (svr->nusers == 1) {
+        // authentication field of default STR records changed
+        tcpsvr_msg_release(svr->table);
+        svr->table = NULL;
+    }
+    return 0;
+}
+
+int ntripsvr_find_mount(struct ntripsvr *svr, const char *name)
+{
+    if (svr->nmounts == 0) {
+        return -1;
+    }
+    int slot = table_slot(svr->mount_table, svr->mount_slots,
+                          (const char *)svr->mounts, sizeof(*svr->mounts), name);
+    return svr->mount_table[slot] - 1;
+}
+
+int ntripsvr_add_mount(struct ntripsvr *svr, const char *name, const char *str)
+{
+    if (name[0] == '\0' || strlen(name) >= sizeof(svr->mounts->name) || strpbrk(name, " /;\r\n") ||
+        (str && strpbrk(str, "\r\n")) || ntripsvr_find_mount(svr, name) != -1) {
+        return -1;
+    }
+    if (svr->nmounts == svr->mounts_cap) {
+        int cap = svr->mounts_cap ? svr->mounts_cap * 2 : 16;
+        struct ntripsvr_mount *mounts = realloc(svr->mounts, cap * sizeof(*mounts));
+        if (mounts == NULL) {
+            return -1;
+        }
+        svr->mounts = mounts;
+        svr->mounts_cap = cap;
+    }
+    struct ntripsvr_mount *m = &svr->mounts[svr->nmounts];
+    snprintf(m->name, sizeof(m->name), "%s", name);
+    m->str = NULL;
+    if (str && (m->str = strdup(str)) == NULL) {
+        return -1;
+    }
+    m->head = -1;
+    m->count = 0;
+    if (table_insert(&svr->mount_table, &svr->mount_slots,
+                     (const char *)svr->mounts, sizeof(*svr->mounts), svr->nmounts + 1) == -1) {
+        free(m->str);
+        return -1;
+    }
+    tcpsvr_msg_release(svr->table);
+    svr->table = NULL;
+    return svr->nmounts++;
+}
+
+int ntripsvr_subscribers(struct ntripsvr *svr, int mount)
+{
+    if (mount < 0 || mount >= svr->nmounts) {
+        return -1;
+    }
+    return svr->mounts[mount].count;
+}
+
+// get STR record of mountpoint with line end, buf is used for default one.
+static const char *ntripsvr_str(struct ntripsvr *svr, const struct ntripsvr_mount *m,
+                                char *buf, size_t size, size_t *len)
+{
+    if (m->str) {
+        *len = strlen(m->str);
+        return m->str;
+    }
+    snprintf(buf, size, "STR;%s;%s;RTCM 3;;;;;;0.00;0.00;0;0;wsocket;none;%c;N;0;",
+             m->name, m->name, svr->nusers > 0 ? 'B' : 'N');
+    *len = strlen(buf);
+    return buf;
+}
+
+// get sourcetable body, it is built once and shared by requests.
+static struct tcpsvr_msg *ntripsvr_table(struct ntripsvr *svr)
+{
+    if (svr->table) {
+        return svr->table;
+    }
+    char buf[160];
+    size_t len = strlen(m_table_end);
+    size_t n = 0;
+    for (int i = 0; i < svr->nmounts; i++) {
+        ntripsvr_str(svr, &svr->mounts[i], buf, sizeof(buf), &n);
+        len += n + 2;
+    }
+    struct tcpsvr_msg *msg = tcpsvr_msg_new(NULL, len);
+    if (msg == NULL) {
+        return NULL;
+    }
+    char *p = tcpsvr_msg_data(msg);
+    for (int i = 0; i < svr->nmounts; i++) {
+        const char *str = ntripsvr_str(svr, &svr->mounts[i], buf, sizeof(buf), &n);
+        memcpy(p, str, n);
+        memcpy(p + n, "\r\n", 2);
+        p += n + 2;
+    }
+    memcpy(p, m_table_end, strlen(m_table_end));
+    svr->table = msg;
+    return msg;
+}
+
+// handle one request line without line end.
+// return 1 if request ends, 0 if more lines expected, -1 if bad request.
+static int ntripsvr_parse_line(struct ntripsvr *svr, struct ntripsvr_conn *conn, char *line)
+{
+    if (conn->state == CONN_REQUEST) {
+        if (strncmp(line, "GET /", 5) != 0) {
+            return -1;
+        }
+        char *name = line + 5;
+        name[strcspn(name, " ")] = '\0';
+        conn->mount = ntripsvr_find_mount(svr, name);
+        conn->state = CONN_HEADER;
+        return 0;
+    }
+    if (line[0] == '\0') {
+        return 1;
+    }
+    if (match_prefix(line, "Ntrip-Version:")) {
+        conn->version = strstr(line, "Ntrip/2.0") ? 2 : 1;
+    } else if (match_prefix(line, "Authorization:")) {
+        char *p = line + 14;
+        p += strspn(p, " \t");
+        if (match_prefix(p, "Basic ") && svr->nusers > 0) {
+            p += 6;
+            p += strspn(p, " \t");
+            p[strcspn(p, " \t")] = '\0';
+            int slot = table_slot(svr->user_table, svr->user_slots,
+                                  (const char *)svr->users, sizeof(*svr->users), p);
+            conn->authed = svr->user_table[slot] != 0;
+        }
+    }
+    return 0;
+}
+
+// send sourcetable to client id and close it.
+static void ntripsvr_send_table(struct ntripsvr *svr, int id)
+{
+    struct tcpsvr_msg *table = ntripsvr_table(svr);
+    if (table == NULL) {
+        tcpsvr_close_client(&svr->tcp, id);
+        return;
+    }
+    size_t len = tcpsvr_msg_size(table);
+    char head[256];
+    if (svr->conns[id].version == 2) {
+        snprintf(head, sizeof(head),
+                 "HTTP/1.1 200 OK\r\n"
+                 "Ntrip-Version: Ntrip/2.0\r\n"
+                 "Server: NTRIP wsocket\r\n"
+                 "Content-Type: gnss/sourcetable\r\n"
+                 "Content-Length: %zu\r\n"
+                 "Connection: close\r\n"
+                 "\r\n", len);
+    } else {
+        snprintf(head, sizeof(head),
+                 "SOURCETABLE 200 OK\r\n"
+                 "Server: NTRIP wsocket\r\n"
+                 "Content-Type: text/plain\r\n"
+                 "Content-Length: %zu\r\n"
+                 "\r\n", len);
+    }
+    if (tcpsvr_send(&svr->tcp, id, head, strlen(head)) == -1 ||
+        tcpsvr_send_msg(&svr->tcp, id, table) == -1) {
+        return;
+    }
+    tcpsvr_close_client(&svr->tcp, id);
+}
+
+// respond to complete request of client id, rv is result of last parsed line.
+static void ntripsvr_respond(struct ntripsvr *svr, int id, int rv)
+{
+    struct ntripsvr_conn *conn = &svr->conns[id];
+    conn->state = CONN_DONE;
+    // response must drain in request_timeout too
+    conn->since = wtime_now();
+    if (rv == -1) {
+        if (tcpsvr_send(&svr->tcp, id, m_bad_request, strlen(m_bad_request)) != -1) {
+            tcpsvr_close_client(&svr->tcp, id);
+        }
+    } else if (conn->mount == -1) {
+        ntripsvr_send_table(svr, id);
+    } else if (svr->nusers > 0 && !conn->authed) {
+        if (tcpsvr_send(&svr->tcp, id, m_unauthorized, strlen(m_unauthorized)) != -1) {
+            tcpsvr_close_client(&svr->tcp, id);
+        }
+    } else {
+        const char *ok = conn->version == 2 ? m_stream_v2 : m_stream_v1;
+        if (tcpsvr_send(&svr->tcp, id, ok, strlen(ok)) != -1) {
+            ntripsvr_subscribe(svr, id);
+        }
+    }
+}
+
+// handle data received from client id
+static void ntripsvr_input(struct ntripsvr *svr, int id, const char *p, size_t n)
+{
+    if (ntripsvr_conn_grow(svr, id) == -1) {
+        tcpsvr_close_client(&svr->tcp, id);
+        return;
+    }
+    struct ntripsvr_conn *conn = &svr->conns[id];
+    if (conn->since == 0) {
+        conn->since = wtime_now();
+    }
+    // data after request, such as GGA of version 1 clients, is ignored
+    while (n > 0 && (conn->state == CONN_REQUEST || conn->state == CONN_HEADER)) {
+        size_t from = conn->len;
+        size_t take = sizeof(conn->line) - conn->len;
+        if (take > n) {
+            take = n;
+        }
+        memcpy(conn->line + conn->len, p, take);
+        conn->len += take;
+        p += take;
+        n -= take;
+        size_t line = 0;
+        int rv = 0;
+        char *lf = NULL;
+        while (rv == 0 && (lf = memchr(conn->line + from, '\n', conn->len - from)) != NULL) {
+            from = lf + 1 - conn->line;
+            if (lf > conn->line + line && lf[-1] == '\r') {
+                lf--;
+            }
+            *lf = '\0';
+            rv = ntripsvr_parse_line(svr, conn, conn->line + line);
+            line = from;
+        }
+        if (rv == 0 && line == 0 && conn->len == sizeof(conn->line)) {
+            // line too long
+            rv = -1;
+        }
+        if (rv != 0) {
+            conn->len = 0;
+            ntripsvr_respond(svr, id, rv);
+            return;
+        }
+        memmove(conn->line, conn->line + line, conn->len - line);
+        conn->len -= line;
+    }
+}
+
+void ntripsvr_set_request_timeout(struct ntripsvr *svr, float timeout)
+{
+    svr->request_timeout = timeout > 0 ? WTIME_FROM_SEC(timeout) : 0;
+}
+
+// close clients still sending request after request_timeout, and drop
+// clients whose response is not drained in request_timeout after it is sent,
+// as peer stops reading. clients which send nothing are not seen by input,
+// they are stamped here on first check.
+static void ntripsvr_check_timeout(struct ntripsvr *svr)
+{
+    int64_t now = wtime_now();
+    if (svr->request_timeout == 0 || now - svr->check_time < WTIME_NS_PER_SEC) {
+        return;
+    }
+    svr->check_time = now;
+    if (svr->tcp.cap == 0 || ntripsvr_conn_grow(svr, svr->tcp.cap - 1) == -1) {
+        return;
+    }
+    int next = -1;
+    for (int id = svr->tcp.head; id != -1; id = next) {
+        next = svr->tcp.clients[id].next;
+        struct ntripsvr_conn *conn = &svr->conns[id];
+        if (conn->state == CONN_STREAM) {
+            continue;
+        }
+        if (conn->since == 0) {
+            conn->since = now;
+        } else if (now - conn->since >= svr->request_timeout) {
+            tcpsvr_abort_client(&svr->tcp, id);
+        }
+    }
+}
+
+int ntripsvr_poll(struct ntripsvr *svr, int timeout)
+{
+    if (tcpsvr_poll(&svr->tcp, timeout) == -1) {
+        return -1;
+    }
+    char buf[4096];
+    int id = -1;
+    for (;;) {
+        int rd = tcpsvr_read_client(&svr->tcp, &id, buf, sizeof(buf));
+        if (rd == -1) {
+            return -1;
+        }
+        if (id == -1) {
+            break;
+        }
+        if (rd > 0) {
+            ntripsvr_input(svr, id, buf, rd);
+        }
+    }
+    ntripsvr_check_timeout(svr);
+    return 0;
+}
+
+int ntripsvr_write(struct ntripsvr *svr, int mount, const void *data, size_t count)
+{
+    if (mount < 0 || mount >= svr->nmounts) {
+        return -1;
+    }
+    struct ntripsvr_mount *m = &svr->mounts[mount];
+    if (m->head == -1) {
+        return count;
+    }
+    struct tcpsvr_msg *msg = tcpsvr_msg_new(data, count);
+    if (msg == NULL) {
+        return -1;
+    }
+    int next = -1;
+    for (int id = m->head; id != -1; id = next) {
+        // client may be closed and unlinked in send
+        next = svr->conns[id].next;
+        tcpsvr_send_msg(&svr->tcp, id, msg);
+    }
+    tcpsvr_msg_release(msg);
+    return count;
+}
+
+int ntripsvr_close(struct ntripsvr *svr)
+{
+    if (svr) {
+        tcpsvr_close(&svr->tcp);
+        free(svr->conns);
+        svr->conns = NULL;
+        svr->nconns = 0;
+        for (int i = 0; i < svr->nmounts; i++) {
+            free(svr->mounts[i].str);
+        }
+        free(svr->mounts);
+        svr->mounts = NULL;
+        svr->nmounts = 0;
+        svr->mounts_cap = 0;
+        free(svr->mount_table);
+        svr->mount_table = NULL;
+        svr->mount_slots = 0;
+        free(svr->users);
+        svr->users = NULL;
+        svr->nusers = 0;
+        svr->users_cap = 0;
+        free(svr->user_table);
+        svr->user_table = NULL;
+        svr->user_slots = 0;
+        tcpsvr_msg_release(svr->table);
+        svr->table = NULL;
+    }
+    return 0;
+}
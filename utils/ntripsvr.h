@@ -0,0 +1,106 @@
+#ifndef NTRIPSVR_H
+#define NTRIPSVR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "tcpsvr.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// max length of request line or header line
+#define NTRIPSVR_MAX_LINE   256
+// default seconds for a client to send its request header
+#define NTRIPSVR_REQUEST_TIMEOUT    10
+
+// client connection state, indexed by tcpsvr client id.
+struct ntripsvr_conn {
+    int    state;   // request parsing state
+    int    version; // NTRIP version of request, 1 or 2
+    int    mount;   // requested mountpoint, -1 for sourcetable
+    int    authed;  // valid credentials given
+    int    prev;    // subscribers list of mountpoint
+    int    next;
+    int64_t since;  // time request started or response sent, 0 if not seen yet
+    size_t len;
+    char   line[NTRIPSVR_MAX_LINE]; // incomplete request line
+};
+
+struct ntripsvr_mount {
+    char   name[32];
+    char  *str;     // sourcetable STR record, without line end
+    int    head;    // first subscriber, -1 if none
+    int    count;   // subscribers count
+};
+
+struct ntripsvr {
+    struct tcpsvr tcp;
+
+    struct ntripsvr_conn *conns; // grows with tcp client slots
+    int     nconns;
+
+    struct ntripsvr_mount *mounts;
+    int     nmounts;
+    int     mounts_cap;
+    int    *mount_table; // hash of mountpoint name, mount index + 1, 0 if empty
+    int     mount_slots; // power of 2
+
+    char  (*users)[64];  // base64 tokens of "user:passwd"
+    int     nusers;
+    int     users_cap;
+    int    *user_table;  // hash of token, same layout as mount_table
+    int     user_slots;
+
+    struct tcpsvr_msg *table; // sourcetable body, rebuilt when mounts change
+
+    int64_t request_timeout; // nanoseconds, 0 means no timeout
+    int64_t check_time;      // last check of request timeout
+};
+
+// init ntripsvr, always return 0.
+// max_cli: max clients count, <= 0 means TCPSVR_MAX_CLI.
+int ntripsvr_init(struct ntripsvr *svr, int max_cli);
+
+// open ntripsvr, opts can be NULL.
+// return 0 on success, -1 on error.
+int ntripsvr_open(struct ntripsvr *svr, const char *addr, int port,
+                  const struct tcpsvr_opts *opts);
+
+// add user credentials, once any user is added, streams require Basic auth.
+// return 0 on success, -1 on error.
+int ntripsvr_add_user(struct ntripsvr *svr, const char *user, const char *passwd);
+
+// add mountpoint. str is its sourcetable STR record without line end, NULL
+// means a minimal one.
+// return mountpoint id, -1 on error or name exists.
+int ntripsvr_add_mount(struct ntripsvr *svr, const char *name, const char *str);
+
+// find mountpoint by name, return mountpoint id, -1 if not found. O(1).
+int ntripsvr_find_mount(struct ntripsvr *svr, const char *name);
+
+// return subscribers count of mountpoint, -1 if invalid.
+int ntripsvr_subscribers(struct ntripsvr *svr, int mount);
+
+// close clients that do not finish request header in timeout seconds, or do
+// not read the whole response in timeout seconds after it is sent, so they
+// can not hold slots forever. <= 0 disables, default is
+// NTRIPSVR_REQUEST_TIMEOUT. clients are checked about once a second.
+void ntripsvr_set_request_timeout(struct ntripsvr *svr, float timeout);
+
+// wait events at most timeout milliseconds same as tcpsvr_poll, then accept
+// clients and handle their requests.
+// return 0 on success, -1 on error.
+int ntripsvr_poll(struct ntripsvr *svr, int timeout);
+
+// write data to subscribers of mountpoint, they share one message, slow
+// clients queue it by reference. cost is O(subscribers).
+// return count, -1 on error or invalid mountpoint.
+int ntripsvr_write(struct ntripsvr *svr, int mount, const void *data, size_t count);
+
+// close ntripsvr and free mountpoints and users, always return 0.
+int ntripsvr_close(struct ntripsvr *svr);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // NTRIPSVR_H
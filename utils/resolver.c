@@ -0,0 +1,268 @@
+#include "resolver.h"
+#include "wtime.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// retry interval of failed refresh, in seconds
+#define REFRESH_RETRY   5
+#define HASH_BUCKETS    64
+
+enum ResolverState {
+    STAT_PENDING,   // first lookup in progress
+    STAT_OK,        // addresses valid
+    STAT_FAILED,    // first lookup failed
+};
+
+struct entry {
+    struct entry *next;
+    char host[64];
+    char serv[32];
+    int socktype;
+
+    int state;
+    int refreshing;     // background lookup running
+    int64_t expire;
+    int naddr;
+    struct resolver_addr addrs[RESOLVER_MAX_ADDR];
+};
+
+static pthread_mutex_t m_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct entry *m_buckets[HASH_BUCKETS];
+static resolver_func m_func = NULL;
+static resolver_free_func m_free_func = NULL;
+static float m_ttl = RESOLVER_TTL;
+
+void resolver_set_backend(resolver_func func, resolver_free_func free_func)
+{
+    pthread_mutex_lock(&m_lock);
+    m_func = func;
+    m_free_func = free_func;
+    pthread_mutex_unlock(&m_lock);
+}
+
+void resolver_set_ttl(float ttl)
+{
+    pthread_mutex_lock(&m_lock);
+    m_ttl = ttl > 0 ? ttl : RESOLVER_TTL;
+    pthread_mutex_unlock(&m_lock);
+}
+
+static unsigned int hash_key(const char *host, const char *serv, int socktype)
+{
+    // FNV-1a
+    unsigned int h = 2166136261u;
+    for (const char *p = host; *p; p++) {
+        h = (h ^ (unsigned char)*p) * 16777619u;
+    }
+    h = (h ^ ':') * 16777619u;
+    for (const char *p = serv; *p; p++) {
+        h = (h ^ (unsigned char)*p) * 16777619u;
+    }
+    h = (h ^ (unsigned int)socktype) * 16777619u;
+    return h % HASH_BUCKETS;
+}
+
+// find entry, lock must be held
+static struct entry *find_entry(const char *host, const char *serv, int socktype)
+{
+    for (struct entry *e = m_buckets[hash_key(host, serv, socktype)]; e; e = e->next) {
+        if (e->socktype == socktype && strcmp(e->host, host) == 0 && strcmp(e->serv, serv) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// create entry, lock must be held
+static struct entry *new_entry(const char *host, const char *serv, int socktype)
+{
+    struct entry *e = calloc(1, sizeof(*e));
+    if (e == NULL) {
+        return NULL;
+    }
+    snprintf(e->host, sizeof(e->host), "%s", host);
+    snprintf(e->serv, sizeof(e->serv), "%s", serv);
+    e->socktype = socktype;
+    e->state = STAT_PENDING;
+    unsigned int h = hash_key(e->host, e->serv, socktype);
+    e->next = m_buckets[h];
+    m_buckets[h] = e;
+    return e;
+}
+
+// unlink and free entry, lock must be held
+static void del_entry(struct entry *e)
+{
+    struct entry **pp = &m_buckets[hash_key(e->host, e->serv, e->socktype)];
+    while (*pp && *pp != e) {
+        pp = &(*pp)->next;
+    }
+    if (*pp) {
+        *pp = e->next;
+    }
+    free(e);
+}
+
+// run backend without lock, return addresses count, -1 on error.
+static int do_resolve(const char *host, const char *serv, int socktype,
+                      struct resolver_addr *addrs, int n)
+{
+    pthread_mutex_lock(&m_lock);
+    resolver_func func = m_func ? m_func : getaddrinfo;
+    resolver_free_func free_func = m_func ? m_free_func : freeaddrinfo;
+    pthread_mutex_unlock(&m_lock);
+
+    struct addrinfo hints = {0};
+    hints.ai_family = PF_UNSPEC;
+    hints.ai_socktype = socktype;
+    hints.ai_protocol = socktype == SOCK_DGRAM ? IPPROTO_UDP : IPPROTO_TCP;
+
+    struct addrinfo *ai = NULL;
+    if (func(host, serv, &hints, &ai) != 0) {
+        return -1;
+    }
+    int cnt = 0;
+    for (const struct addrinfo *p = ai; p != NULL && cnt < n; p = p->ai_next) {
+        if (p->ai_addrlen > sizeof(addrs[cnt].addr)) {
+            continue;
+        }
+        addrs[cnt].family = p->ai_family;
+        addrs[cnt].socktype = p->ai_socktype;
+        addrs[cnt].protocol = p->ai_protocol;
+        addrs[cnt].addrlen = p->ai_addrlen;
+        memcpy(&addrs[cnt].addr, p->ai_addr, p->ai_addrlen);
+        cnt++;
+    }
+    if (free_func && ai) {
+        free_func(ai);
+    }
+    return cnt > 0 ? cnt : -1;
+}
+
+// store lookup result, lock must be held
+static void store_result(struct entry *e, const struct resolver_addr *addrs, int cnt)
+{
+    if (cnt > 0) {
+        memcpy(e->addrs, addrs, cnt * sizeof(addrs[0]));
+        e->naddr = cnt;
+        e->state = STAT_OK;
+        e->expire = wtime_now() + WTIME_FROM_SEC(m_ttl);
+    } else if (e->state == STAT_OK) {
+        // keep old addresses, retry later
+        e->expire = wtime_now() + REFRESH_RETRY * WTIME_NS_PER_SEC;
+    } else {
+        e->state = STAT_FAILED;
+    }
+    e->refreshing = 0;
+}
+
+static void *resolve_worker(void *arg)
+{
+    struct entry *e = arg;
+    char host[64];
+    char serv[32];
+    pthread_mutex_lock(&m_lock);
+    snprintf(host, sizeof(host), "%s", e->host);
+    snprintf(serv, sizeof(serv), "%s", e->serv);
+    int socktype = e->socktype;
+    pthread_mutex_unlock(&m_lock);
+
+    struct resolver_addr addrs[RESOLVER_MAX_ADDR];
+    int cnt = do_resolve(host, serv, socktype, addrs, RESOLVER_MAX_ADDR);
+
+    pthread_mutex_lock(&m_lock);
+    store_result(e, addrs, cnt);
+    pthread_mutex_unlock(&m_lock);
+    return NULL;
+}
+
+// start background lookup, lock must be held. return 0 on success, -1 on error.
+static int start_worker(struct entry *e)
+{
+    pthread_t tid;
+    e->refreshing = 1;
+    if (pthread_create(&tid, NULL, resolve_worker, e) != 0) {
+        e->refreshing = 0;
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
+
+// copy entry addresses, lock must be held
+static int copy_addrs(const struct entry *e, struct resolver_addr *addrs, int n)
+{
+    int cnt = e->naddr < n ? e->naddr : n;
+    memcpy(addrs, e->addrs, cnt * sizeof(addrs[0]));
+    return cnt;
+}
+
+int resolver_resolve(const char *host, const char *serv, int socktype,
+                     struct resolver_addr *addrs, int n)
+{
+    struct resolver_addr res[RESOLVER_MAX_ADDR];
+    int cnt = do_resolve(host, serv, socktype, res, RESOLVER_MAX_ADDR);
+    if (cnt < 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&m_lock);
+    struct entry *e = find_entry(host, serv, socktype);
+    if (e == NULL) {
+        e = new_entry(host, serv, socktype);
+    }
+    if (e && !e->refreshing) {
+        store_result(e, res, cnt);
+    }
+    pthread_mutex_unlock(&m_lock);
+    cnt = cnt < n ? cnt : n;
+    memcpy(addrs, res, cnt * sizeof(res[0]));
+    return cnt;
+}
+
+int resolver_lookup(const char *host, const char *serv, int socktype,
+                    struct resolver_addr *addrs, int n)
+{
+    int rv = 0;
+    pthread_mutex_lock(&m_lock);
+    struct entry *e = find_entry(host, serv, socktype);
+    if (e == NULL) {
+        e = new_entry(host, serv, socktype);
+        if (e == NULL || start_worker(e) == -1) {
+            if (e) {
+                del_entry(e);
+            }
+            rv = -1;
+        }
+    } else if (e->state == STAT_OK) {
+        if (!e->refreshing && wtime_now() >= e->expire) {
+            start_worker(e);
+        }
+        rv = copy_addrs(e, addrs, n);
+    } else if (e->state == STAT_FAILED) {
+        // report once, next lookup starts over
+        del_entry(e);
+        rv = -1;
+    }
+    pthread_mutex_unlock(&m_lock);
+    return rv;
+}
+
+void resolver_flush(void)
+{
+    pthread_mutex_lock(&m_lock);
+    for (int i = 0; i < HASH_BUCKETS; i++) {
+        struct entry **pp = &m_buckets[i];
+        while (*pp) {
+            struct entry *e = *pp;
+            if (e->refreshing) {
+                pp = &e->next;
+            } else {
+                *pp = e->next;
+                free(e);
+            }
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+}
@@ -0,0 +1,56 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "../wsocket.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// max addresses kept for one host
+#define RESOLVER_MAX_ADDR   8
+// default cache ttl, in seconds
+#define RESOLVER_TTL        300
+
+// resolved address
+struct resolver_addr {
+    int family;
+    int socktype;
+    int protocol;
+    socklen_t addrlen;
+    struct sockaddr_storage addr;
+};
+
+// resolve backend, same as getaddrinfo/freeaddrinfo.
+typedef int (*resolver_func)(const char *node, const char *service,
+                             const struct addrinfo *hints, struct addrinfo **res);
+typedef void (*resolver_free_func)(struct addrinfo *res);
+
+// replace resolve backend, e.g. a local stub for testing.
+// NULL means getaddrinfo/freeaddrinfo.
+void resolver_set_backend(resolver_func func, resolver_free_func free_func);
+
+// set cache ttl in seconds, <= 0 means RESOLVER_TTL.
+void resolver_set_ttl(float ttl);
+
+// resolve host:serv synchronously and cache the result.
+// socktype: SOCK_STREAM or SOCK_DGRAM.
+// return addresses count filled into addrs, -1 on error.
+int resolver_resolve(const char *host, const char *serv, int socktype,
+                     struct resolver_addr *addrs, int n);
+
+// lookup host:serv in cache without blocking, a background lookup is started
+// on cache miss. expired entry is refreshed in background and old addresses
+// are still returned meanwhile.
+// return addresses count filled into addrs, 0 if lookup is in progress, -1 if
+// lookup failed.
+int resolver_lookup(const char *host, const char *serv, int socktype,
+                    struct resolver_addr *addrs, int n);
+
+// drop all cached entries except those being resolved.
+void resolver_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // RESOLVER_H
@@ -0,0 +1,142 @@
+#include "rtcm3.h"
+#include <pthread.h>
+#include <string.h>
+
+// CRC-24Q polynomial, aligned to top of 32 bits register
+#define CRC24Q_POLY 0x864CFB00u
+
+// slice-by-8 tables
+static uint32_t m_crc_table[8][256];
+static pthread_once_t m_crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_table_init(void)
+{
+    for (int b = 0; b < 256; b++) {
+        uint32_t reg = (uint32_t)b << 24;
+        for (int i = 0; i < 8; i++) {
+            reg = (reg & 0x80000000u) ? (reg << 1) ^ CRC24Q_POLY : reg << 1;
+        }
+        m_crc_table[0][b] = reg;
+    }
+    for (int k = 1; k < 8; k++) {
+        for (int b = 0; b < 256; b++) {
+            uint32_t prev = m_crc_table[k - 1][b];
+            m_crc_table[k][b] = (prev << 8) ^ m_crc_table[0][prev >> 24];
+        }
+    }
+}
+
+uint32_t rtcm3_crc24q(const void *data, size_t len)
+{
+    pthread_once(&m_crc_once, crc_table_init);
+    const unsigned char *p = data;
+    uint32_t crc = 0;
+    while (len >= 8) {
+        uint32_t hi = crc ^ ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]);
+        crc = m_crc_table[7][hi >> 24] ^ m_crc_table[6][(hi >> 16) & 0xFF] ^
+              m_crc_table[5][(hi >> 8) & 0xFF] ^ m_crc_table[4][hi & 0xFF] ^
+              m_crc_table[3][p[4]] ^ m_crc_table[2][p[5]] ^
+              m_crc_table[1][p[6]] ^ m_crc_table[0][p[7]];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = (crc << 8) ^ m_crc_table[0][(crc >> 24) ^ *p++];
+    }
+    return crc >> 8;
+}
+
+void rtcm3_init(struct rtcm3_framer *framer, rtcm3_cb cb, void *arg)
+{
+    pthread_once(&m_crc_once, crc_table_init);
+    memset(framer, 0, sizeof(*framer));
+    framer->cb = cb;
+    framer->arg = arg;
+}
+
+void rtcm3_reset(struct rtcm3_framer *framer)
+{
+    framer->len = 0;
+}
+
+// find and deliver complete frames in p, return bytes consumed. the rest
+// starts with preamble of an incomplete frame.
+static size_t scan(struct rtcm3_framer *framer, const unsigned char *p, size_t n)
+{
+    size_t i = 0;
+    while (i < n) {
+        if (p[i] != RTCM3_PREAMBLE) {
+            const unsigned char *q = memchr(p + i, RTCM3_PREAMBLE, n - i);
+            if (q == NULL) {
+                framer->skipped += n - i;
+                return n;
+            }
+            framer->skipped += q - (p + i);
+            i = q - p;
+        }
+        if (n - i < 3) {
+            break;
+        }
+        if (p[i + 1] & 0xFC) {
+            // reserved bits must be 0, not a frame
+            framer->skipped++;
+            i++;
+            continue;
+        }
+        size_t plen = ((size_t)(p[i + 1] & 0x03) << 8) | p[i + 2];
+        if (n - i < plen + 6) {
+            break;
+        }
+        const unsigned char *c = p + i + 3 + plen;
+        uint32_t crc = (uint32_t)c[0] << 16 | (uint32_t)c[1] << 8 | c[2];
+        if (rtcm3_crc24q(p + i, plen + 3) != crc) {
+            // false preamble or corrupted, search again from next byte
+            framer->crc_errors++;
+            framer->skipped++;
+            i++;
+            continue;
+        }
+        int type = plen >= 2 ? (p[i + 3] << 4) | (p[i + 4] >> 4) : 0;
+        framer->msgs++;
+        framer->types[type]++;
+        if (framer->cb) {
+            framer->cb(type, p + i + 3, plen, framer->arg);
+        }
+        i += plen + 6;
+    }
+    return i;
+}
+
+int rtcm3_input(struct rtcm3_framer *framer, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    uint64_t msgs = framer->msgs;
+    // complete buffered frame first, only this part is copied
+    while (framer->len > 0 && len > 0) {
+        size_t old = framer->len;
+        size_t take = RTCM3_MAX_FRAME - old;
+        if (take > len) {
+            take = len;
+        }
+        memcpy(framer->buf + old, p, take);
+        size_t total = old + take;
+        size_t used = scan(framer, framer->buf, total);
+        if (used >= old) {
+            // buffered bytes done, scan the rest in place
+            p += used - old;
+            len -= used - old;
+            framer->len = 0;
+        } else {
+            memmove(framer->buf, framer->buf + used, total - used);
+            framer->len = total - used;
+            p += take;
+            len -= take;
+        }
+    }
+    if (len > 0) {
+        size_t used = scan(framer, p, len);
+        memcpy(framer->buf, p + used, len - used);
+        framer->len = len - used;
+    }
+    return (int)(framer->msgs - msgs);
+}
@@ -0,0 +1,52 @@
+#ifndef RTCM3_H
+#define RTCM3_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTCM3_PREAMBLE      0xD3
+#define RTCM3_MAX_PAYLOAD   1023
+// preamble and length (3 bytes), payload, CRC-24Q (3 bytes)
+#define RTCM3_MAX_FRAME     (RTCM3_MAX_PAYLOAD + 6)
+// message type is 12 bits
+#define RTCM3_MAX_TYPE      4096
+
+// called for each valid message, payload points into input data or into
+// framer buffer if the message was split across inputs, and is only valid in
+// callback. whole frame starts 3 bytes before payload.
+typedef void (*rtcm3_cb)(int type, const unsigned char *payload, size_t len, void *arg);
+
+// RTCM3 stream framer, finds messages in a byte stream of any chunking.
+struct rtcm3_framer {
+    rtcm3_cb cb;
+    void *arg;
+    unsigned char buf[RTCM3_MAX_FRAME]; // incomplete frame of last input
+    size_t len;
+
+    uint64_t msgs;          // valid messages count
+    uint64_t crc_errors;    // frames dropped by CRC
+    uint64_t skipped;       // bytes skipped while searching preamble
+    uint32_t types[RTCM3_MAX_TYPE]; // valid messages count of each type
+};
+
+// calculate CRC-24Q of data.
+uint32_t rtcm3_crc24q(const void *data, size_t len);
+
+// init framer, cb is called with arg for each valid message.
+void rtcm3_init(struct rtcm3_framer *framer, rtcm3_cb cb, void *arg);
+
+// input stream data, complete messages are passed to callback in order.
+// return valid messages count found.
+int rtcm3_input(struct rtcm3_framer *framer, const void *data, size_t len);
+
+// drop buffered incomplete frame, call it when stream restarts.
+void rtcm3_reset(struct rtcm3_framer *framer);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // RTCM3_H
@@ -0,0 +1,291 @@
+#include "sourcetable.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+// max fields of a record used
+#define MAX_FIELDS  20
+
+void sourcetable_init(struct sourcetable *tab)
+{
+    memset(tab, 0, sizeof(*tab));
+}
+
+void sourcetable_reset(struct sourcetable *tab)
+{
+    tab->nstr = 0;
+    tab->ncas = 0;
+    tab->nnet = 0;
+    tab->nindex = 0;
+    tab->done = 0;
+    tab->skip = 0;
+    tab->len = 0;
+}
+
+void sourcetable_free(struct sourcetable *tab)
+{
+    free(tab->strs);
+    free(tab->cas);
+    free(tab->nets);
+    free(tab->index);
+    sourcetable_init(tab);
+}
+
+// grow array of *cap items of size bytes for one more, return 0, -1 on no memory.
+static int grow(void **items, int *cap, int count, size_t size)
+{
+    if (count < *cap) {
+        return 0;
+    }
+    int n = *cap ? *cap * 2 : 64;
+    void *p = realloc(*items, n * size);
+    if (p == NULL) {
+        return -1;
+    }
+    *items = p;
+    *cap = n;
+    return 0;
+}
+
+static void copy_field(char *dst, size_t size, const char *src)
+{
+    snprintf(dst, size, "%s", src);
+}
+
+static float float_field(const char *s)
+{
+    return (float)strtod(s, NULL);
+}
+
+// split line into fields by ';', missing fields are empty.
+static void split(char *line, char **fields)
+{
+    int n = 0;
+    fields[n++] = line;
+    for (char *p = line; *p && n < MAX_FIELDS; p++) {
+        if (*p == ';') {
+            *p = '\0';
+            fields[n++] = p + 1;
+        }
+    }
+    while (n < MAX_FIELDS) {
+        fields[n++] = "";
+    }
+}
+
+// parse one record line without line end.
+// return -1 on no memory, 0 otherwise.
+static int parse_line(struct sourcetable *tab, char *line)
+{
+    char *f[MAX_FIELDS];
+    if (strncmp(line, "STR;", 4) == 0) {
+        if (grow((void **)&tab->strs, &tab->str_cap, tab->nstr, sizeof(*tab->strs)) == -1) {
+            return -1;
+        }
+        split(line, f);
+        struct sourcetable_str *s = &tab->strs[tab->nstr++];
+        copy_field(s->mnt, sizeof(s->mnt), f[1]);
+        copy_field(s->ident, sizeof(s->ident), f[2]);
+        copy_field(s->format, sizeof(s->format), f[3]);
+        s->carrier = atoi(f[5]);
+        copy_field(s->nav, sizeof(s->nav), f[6]);
+        copy_field(s->network, sizeof(s->network), f[7]);
+        copy_field(s->country, sizeof(s->country), f[8]);
+        s->lat = float_field(f[9]);
+        s->lon = float_field(f[10]);
+        s->nmea = atoi(f[11]);
+        s->solution = atoi(f[12]);
+        s->auth = f[15][0] ? f[15][0] : 'N';
+        s->fee = f[16][0] ? f[16][0] : 'N';
+        s->bitrate = atoi(f[17]);
+    } else if (strncmp(line, "CAS;", 4) == 0) {
+        if (grow((void **)&tab->cas, &tab->cas_cap, tab->ncas, sizeof(*tab->cas)) == -1) {
+            return -1;
+        }
+        split(line, f);
+        struct sourcetable_cas *c = &tab->cas[tab->ncas++];
+        copy_field(c->host, sizeof(c->host), f[1]);
+        c->port = atoi(f[2]);
+        copy_field(c->ident, sizeof(c->ident), f[3]);
+        copy_field(c->operator_, sizeof(c->operator_), f[4]);
+        copy_field(c->country, sizeof(c->country), f[6]);
+        c->lat = float_field(f[7]);
+        c->lon = float_field(f[8]);
+    } else if (strncmp(line, "NET;", 4) == 0) {
+        if (grow((void **)&tab->nets, &tab->net_cap, tab->nnet, sizeof(*tab->nets)) == -1) {
+            return -1;
+        }
+        split(line, f);
+        struct sourcetable_net *n = &tab->nets[tab->nnet++];
+        copy_field(n->ident, sizeof(n->ident), f[1]);
+        copy_field(n->operator_, sizeof(n->operator_), f[2]);
+        n->auth = f[3][0] ? f[3][0] : 'N';
+        n->fee = f[4][0] ? f[4][0] : 'N';
+    } else if (strcmp(line, "ENDSOURCETABLE") == 0) {
+        tab->done = 1;
+    }
+    // others, such as comments, are ignored
+    return 0;
+}
+
+int sourcetable_input(struct sourcetable *tab, const void *data, size_t len)
+{
+    const char *p = data;
+    while (len > 0 && !tab->done) {
+        const char *lf = memchr(p, '\n', len);
+        size_t n = lf ? (size_t)(lf - p) : len;
+        if (!tab->skip) {
+            size_t take = sizeof(tab->line) - 1 - tab->len;
+            if (take > n) {
+                take = n;
+            }
+            memcpy(tab->line + tab->len, p, take);
+            tab->len += take;
+        }
+        if (lf == NULL && tab->len < sizeof(tab->line) - 1) {
+            break;
+        }
+        if (!tab->skip) {
+            // line complete, or too long and parsed truncated
+            if (tab->len > 0 && tab->line[tab->len - 1] == '\r') {
+                tab->len--;
+            }
+            tab->line[tab->len] = '\0';
+            if (parse_line(tab, tab->line) == -1) {
+                return -1;
+            }
+            tab->len = 0;
+        }
+        tab->skip = lf == NULL;
+        if (lf == NULL) {
+            break;
+        }
+        p = lf + 1;
+        len -= n + 1;
+    }
+    return tab->done;
+}
+
+static int compare_mnt(const void *a, const void *b)
+{
+    const struct sourcetable_str *x = *(const struct sourcetable_str * const *)a;
+    const struct sourcetable_str *y = *(const struct sourcetable_str * const *)b;
+    int rv = strcmp(x->mnt, y->mnt);
+    // keep table order of same mountpoint
+    return rv != 0 ? rv : (x < y ? -1 : x > y);
+}
+
+int sourcetable_find(struct sourcetable *tab, const char *mnt)
+{
+    if (tab->nindex != tab->nstr) {
+        const struct sourcetable_str **index = realloc(tab->index, tab->nstr * sizeof(*index));
+        if (index == NULL && tab->nstr > 0) {
+            return -1;
+        }
+        for (int i = 0; i < tab->nstr; i++) {
+            index[i] = &tab->strs[i];
+        }
+        qsort(index, tab->nstr, sizeof(*index), compare_mnt);
+        tab->index = index;
+        tab->nindex = tab->nstr;
+    }
+    // first record not less than mnt
+    int lo = 0;
+    int hi = tab->nindex;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strcmp(tab->index[mid]->mnt, mnt) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < tab->nindex && strcmp(tab->index[lo]->mnt, mnt) == 0) {
+        return tab->index[lo] - tab->strs;
+    }
+    return -1;
+}
+
+// case insensitive prefix match, NULL prefix matches all.
+static int match_format(const char *s, const char *prefix)
+{
+    if (prefix == NULL) {
+        return 1;
+    }
+    while (*prefix) {
+        if (tolower((unsigned char)*s++) != tolower((unsigned char)*prefix++)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int sourcetable_filter(const struct sourcetable *tab, const char *format, int *out, int max)
+{
+    int n = 0;
+    for (int i = 0; i < tab->nstr && n < max; i++) {
+        if (match_format(tab->strs[i].format, format)) {
+            out[n++] = i;
+        }
+    }
+    return n;
+}
+
+// cosine of degrees in [-90, 90] by Taylor series, error < 1e-6, enough for
+// ranking distances without libm.
+static double cos_deg(double deg)
+{
+    double x = deg * 3.14159265358979323846 / 180;
+    double x2 = x * x;
+    return 1 - x2 / 2 * (1 - x2 / 12 * (1 - x2 / 30 * (1 - x2 / 56 * (1 - x2 / 90 * (1 - x2 / 132)))));
+}
+
+// squared equirectangular distance in degrees, monotonic with great circle
+// distance for ranking nearby stations.
+static double distance2(double lat, double lon, double coslat, const struct sourcetable_str *s)
+{
+    double dlon = s->lon - lon;
+    while (dlon > 180) {
+        dlon -= 360;
+    }
+    while (dlon < -180) {
+        dlon += 360;
+    }
+    double dx = dlon * coslat;
+    double dy = s->lat - lat;
+    return dx * dx + dy * dy;
+}
+
+int sourcetable_nearest(const struct sourcetable *tab, double lat, double lon,
+                        const char *format, int *out, int max)
+{
+    if (max <= 0) {
+        return 0;
+    }
+    double coslat = cos_deg(lat < -90 ? -90 : lat > 90 ? 90 : lat);
+    double *dist = malloc(max * sizeof(*dist));
+    if (dist == NULL) {
+        return 0;
+    }
+    // keep max nearest sorted by insertion, O(n * max) for small max
+    int n = 0;
+    for (int i = 0; i < tab->nstr; i++) {
+        if (!match_format(tab->strs[i].format, format)) {
+            continue;
+        }
+        double d = distance2(lat, lon, coslat, &tab->strs[i]);
+        if (n == max && d >= dist[n - 1]) {
+            continue;
+        }
+        int j = n < max ? n++ : n - 1;
+        for (; j > 0 && dist[j - 1] > d; j--) {
+            dist[j] = dist[j - 1];
+            out[j] = out[j - 1];
+        }
+        dist[j] = d;
+        out[j] = i;
+    }
+    free(dist);
+    return n;
+}
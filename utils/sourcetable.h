@@ -0,0 +1,104 @@
+#ifndef SOURCETABLE_H
+#define SOURCETABLE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// max length of a record line, longer lines are parsed truncated
+#define SOURCETABLE_MAX_LINE    512
+
+// STR record, a data stream
+struct sourcetable_str {
+    char  mnt[32];
+    char  ident[32];    // source identifier, e.g. city
+    char  format[24];   // e.g. "RTCM 3.2"
+    char  nav[24];      // navigation systems, e.g. "GPS+GLO"
+    char  network[24];
+    char  country[4];
+    float lat;          // degrees
+    float lon;
+    int   carrier;      // 0 none, 1 L1, 2 L1+L2
+    int   nmea;         // client must send NMEA
+    int   solution;     // 0 single base, 1 network
+    int   bitrate;
+    char  auth;         // N none, B basic, D digest
+    char  fee;          // N no, Y yes
+};
+
+// CAS record, a caster
+struct sourcetable_cas {
+    char  host[64];
+    int   port;
+    char  ident[32];
+    char  operator_[32];
+    char  country[4];
+    float lat;
+    float lon;
+};
+
+// NET record, a network of streams
+struct sourcetable_net {
+    char  ident[32];
+    char  operator_[32];
+    char  auth;
+    char  fee;
+};
+
+// sourcetable parsed from a stream of any chunking, only record arrays and
+// one line are kept.
+struct sourcetable {
+    struct sourcetable_str *strs;
+    int    nstr;
+    int    str_cap;
+    struct sourcetable_cas *cas;
+    int    ncas;
+    int    cas_cap;
+    struct sourcetable_net *nets;
+    int    nnet;
+    int    net_cap;
+
+    const struct sourcetable_str **index; // STR records sorted by mountpoint
+    int    nindex;  // records in index, rebuilt when it differs from nstr
+
+    int    done;    // ENDSOURCETABLE received
+    int    skip;    // rest of too long line is ignored
+    size_t len;
+    char   line[SOURCETABLE_MAX_LINE]; // incomplete line
+};
+
+// init empty sourcetable.
+void sourcetable_init(struct sourcetable *tab);
+
+// input sourcetable body, records are added as lines complete.
+// return 1 if ENDSOURCETABLE is received, 0 if more data expected, -1 on no
+// memory.
+int sourcetable_input(struct sourcetable *tab, const void *data, size_t len);
+
+// drop all records, call it when a new response starts.
+void sourcetable_reset(struct sourcetable *tab);
+
+// find STR record by mountpoint, O(log n), index is built on first lookup
+// after records change.
+// return record index, -1 if not found.
+int sourcetable_find(struct sourcetable *tab, const char *mnt);
+
+// get STR records whose format starts with format, case insensitive, in table
+// order. format NULL matches all.
+// return count of record indexes written into out, at most max.
+int sourcetable_filter(const struct sourcetable *tab, const char *format, int *out, int max);
+
+// same as sourcetable_filter, but the nearest records to lat/lon (degrees),
+// nearest first.
+int sourcetable_nearest(const struct sourcetable *tab, double lat, double lon,
+                        const char *format, int *out, int max);
+
+// free records.
+void sourcetable_free(struct sourcetable *tab);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // SOURCETABLE_H
@@ -1,101 +1,293 @@
 #include "tcpcli.h"
+#include "resolver.h"
+#include "wtime.h"
 #include <stdio.h>
-#include <time.h>
+#include <limits.h>
+#include <string.h>
 
-static double local_timestamp(const struct timespec *ts)
-{
-    double stamp = ts->tv_sec;
-    stamp += ts->tv_nsec * 1E-9;
-    return stamp;
-}
-
-static double local_monotonic_clock()
-{
-    struct timespec ts = { 0 };
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return local_timestamp(&ts);
-}
+// resolver and polled connects have no notification, with timer wheel they
+// are checked at this interval, in nanoseconds
+#define CHECK_INTERVAL  (50 * WTIME_NS_PER_MS)
 
 enum TcpcliState {
     STAT_ERROR,     // error
     STAT_WAIT,      // waiting
     STAT_CONNECTING,// connecting
     STAT_CONNECTED, // connected
+    STAT_RESOLVING, // resolving address
 };
 
-static wsocket connect_to(const char *addr, const char *service)
+// current time, wheel time if attached to timer wheel
+static int64_t tcpcli_now(struct tcpcli *tcp)
 {
-    wsocket sock = INVALID_WSOCKET;
+    return tcp->wheel ? (int64_t)tcp->wheel->time * WTIME_NS_PER_MS : wtime_now();
+}
 
-    struct addrinfo hints = {0};
-    hints.ai_family = PF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = IPPROTO_TCP;
+// get next deadline of current state. < 0 means none.
+static int64_t tcpcli_deadline(struct tcpcli *tcp, int64_t now)
+{
+    int64_t t = -1;
+    switch (tcp->state) {
+    case STAT_ERROR:
+        // run state machine soon to close sockets
+        if (tcp->socket != INVALID_WSOCKET || tcp->nattempt > 0) {
+            t = now;
+        }
+        break;
+    case STAT_WAIT:
+        if (tcp->reconnect_wait >= 0) {
+            t = tcp->activity + WTIME_FROM_SEC(tcp->reconnect_wait);
+        }
+        break;
+    case STAT_RESOLVING:
+        t = now + CHECK_INTERVAL;
+        break;
+    case STAT_CONNECTING:
+        if (tcp->watch == NULL) {
+            t = now + CHECK_INTERVAL;
+        }
+        if (tcp->nattempt < TCPCLI_MAX_ATTEMPTS && tcp->next_addr < tcp->naddr &&
+            (t < 0 || tcp->next_attempt < t)) {
+            t = tcp->next_attempt;
+        }
+        if (tcp->connect_timeout > 0 && (t < 0 || tcp->activity + WTIME_FROM_SEC(tcp->connect_timeout) < t)) {
+            t = tcp->activity + WTIME_FROM_SEC(tcp->connect_timeout);
+        }
+        break;
+    case STAT_CONNECTED:
+        if (tcp->inactive_timeout > 0) {
+            t = tcp->activity + WTIME_FROM_SEC(tcp->inactive_timeout);
+        }
+        break;
+    }
+    return t;
+}
 
-    int rv = 0;
-    struct addrinfo *ai = NULL;
-    if ((rv = getaddrinfo(addr, service, &hints, &ai)) != 0) {
-        return INVALID_WSOCKET;
+// arm timer to deadline of current state. an earlier pending timer is kept,
+// it arms again when expired, so activity updates cost nothing.
+static void tcpcli_arm(struct tcpcli *tcp)
+{
+    if (tcp->wheel == NULL) {
+        return;
+    }
+    int64_t t = tcpcli_deadline(tcp, tcpcli_now(tcp));
+    if (t < 0) {
+        wtimer_del(tcp->wheel, &tcp->timer);
+        return;
     }
-    for (const struct addrinfo *p = ai; p != NULL; p = p->ai_next) {
+    // round up, so state machine sees deadline passed
+    uint64_t expire = t / WTIME_NS_PER_MS + 1;
+    if (!wtimer_pending(&tcp->timer) || expire < tcp->timer.expire) {
+        wtimer_add(tcp->wheel, &tcp->timer, expire);
+    }
+}
+
+// start non-blocking connect to addr
+static wsocket connect_to(const struct resolver_addr *p)
+{
 #ifdef SOCK_CLOEXEC
-        sock = socket(p->ai_family, p->ai_socktype | SOCK_CLOEXEC, p->ai_protocol);
+    wsocket sock = socket(p->family, p->socktype | SOCK_CLOEXEC, p->protocol);
 #else
-        sock = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+    wsocket sock = socket(p->family, p->socktype, p->protocol);
 #endif
-        if (sock == INVALID_WSOCKET) {
-            continue;
+    if (sock == INVALID_WSOCKET) {
+        return INVALID_WSOCKET;
+    }
+    if (wsocket_set_nonblocking(sock) == WSOCKET_ERROR) {
+        wsocket_close(sock);
+        return INVALID_WSOCKET;
+    }
+    if (connect(sock, (const struct sockaddr *)&p->addr, p->addrlen) == WSOCKET_ERROR &&
+        wsocket_errno != WSOCKET_EINPROGRESS) {
+        // connect error
+        wsocket_close(sock);
+        return INVALID_WSOCKET;
+    }
+    return sock;
+}
+
+// tell external watcher wanted events of sock, 0 means sock is closing
+static void tcpcli_watch(struct tcpcli *tcp, wsocket sock, int events)
+{
+    if (tcp->watch && sock != INVALID_WSOCKET) {
+        tcp->watch(tcp, sock, events, tcp->watch_arg);
+    }
+}
+
+static void tcpcli_close_socket(struct tcpcli *tcp, wsocket sock)
+{
+    tcpcli_watch(tcp, sock, 0);
+    wsocket_close(sock);
+}
+
+// close all connect attempts
+static void tcpcli_close_attempts(struct tcpcli *tcp)
+{
+    for (int i = 0; i < tcp->nattempt; i++) {
+        tcpcli_close_socket(tcp, tcp->attempts[i]);
+    }
+    tcp->nattempt = 0;
+}
+
+// start connect attempt to next candidate address.
+// return 0 on success, -1 if no address left.
+static int tcpcli_next_attempt(struct tcpcli *tcp, int64_t now)
+{
+    while (tcp->next_addr < tcp->naddr) {
+        wsocket sock = connect_to(&tcp->addrs[tcp->next_addr++]);
+        if (sock != INVALID_WSOCKET) {
+            tcp->attempts[tcp->nattempt++] = sock;
+            tcp->next_attempt = now + WTIME_FROM_SEC(TCPCLI_ATTEMPT_DELAY);
+            tcpcli_watch(tcp, sock, TCPCLI_EV_WRITE);
+            return 0;
         }
-        if (wsocket_set_nonblocking(sock) == WSOCKET_ERROR) {
-            wsocket_close(sock);
-            return INVALID_WSOCKET;
+    }
+    return -1;
+}
+
+// start racing connects to addrs, in RFC 8305 order: address families are
+// interleaved, starting with the family of first address.
+// return 0 on success, -1 on error.
+static int tcpcli_start_connect(struct tcpcli *tcp, const struct resolver_addr *addrs, int naddr, int64_t now)
+{
+    int first = 0;
+    int other = 0;
+    tcp->naddr = 0;
+    while (tcp->naddr < naddr) {
+        while (first < naddr && addrs[first].family != addrs[0].family) {
+            first++;
         }
-        if (connect(sock, p->ai_addr, p->ai_addrlen) == WSOCKET_ERROR &&
-            wsocket_errno != WSOCKET_EINPROGRESS) {
-            // connect error
-            wsocket_close(sock);
-            sock = INVALID_WSOCKET;
-            continue;
+        if (first < naddr) {
+            tcp->addrs[tcp->naddr++] = addrs[first++];
         }
-        // Got it!
-        break;
+        while (other < naddr && addrs[other].family == addrs[0].family) {
+            other++;
+        }
+        if (other < naddr) {
+            tcp->addrs[tcp->naddr++] = addrs[other++];
+        }
+    }
+    tcp->next_addr = 0;
+    tcpcli_close_attempts(tcp);
+    if (tcpcli_next_attempt(tcp, now) == -1) {
+        return -1;
+    }
+    tcp->state = STAT_CONNECTING;
+    tcp->activity = now;
+    return 0;
+}
+
+// finish connect attempt i which is reported writable.
+// return 1 if connected, 0 if failed.
+static int tcpcli_attempt_done(struct tcpcli *tcp, int i, int64_t now)
+{
+    wsocket sock = tcp->attempts[i];
+    tcp->attempts[i] = tcp->attempts[--tcp->nattempt];
+    // check connected
+    int so_err = 0;
+    socklen_t len = sizeof(so_err);
+    if (getsockopt(sock, SOL_SOCKET, SO_ERROR, (char *)&so_err, &len) == -1 || so_err != 0) {
+        // failed, try next address at once
+        tcpcli_close_socket(tcp, sock);
+        tcp->next_attempt = now;
+        return 0;
     }
+    // OK, data of last connection is useless now
+    tcpcli_close_attempts(tcp);
+    wring_clear(&tcp->rx);
+    tcp->socket = sock;
+    tcp->state = STAT_CONNECTED;
+    tcp->activity = now;
+    tcpcli_watch(tcp, sock, TCPCLI_EV_READ);
+    return 1;
+}
 
-    freeaddrinfo(ai);
-    ai = NULL;
-    return sock;
+// check connect attempts, first connected one wins.
+// with external watcher, attempts are finished by tcpcli_notify, only timers
+// are checked here.
+static void tcpcli_check_connect(struct tcpcli *tcp, int64_t now)
+{
+    if (tcp->watch == NULL && tcp->nattempt > 0) {
+        wsocket_pollfd fds[TCPCLI_MAX_ATTEMPTS];
+        int n = tcp->nattempt;
+        for (int i = 0; i < n; i++) {
+            fds[i].fd = tcp->attempts[i];
+            fds[i].events = POLLOUT;
+            fds[i].revents = 0;
+        }
+        int err = wsocket_pollfds(fds, n, 0);
+        if (err == -1) {
+            // error
+            tcp->state = STAT_ERROR;
+            return;
+        }
+        for (int i = 0; i < n && err > 0; i++) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            int idx = 0;
+            while (idx < tcp->nattempt && tcp->attempts[idx] != fds[i].fd) {
+                idx++;
+            }
+            if (idx < tcp->nattempt && tcpcli_attempt_done(tcp, idx, now)) {
+                return;
+            }
+        }
+    }
+    if (tcp->nattempt < TCPCLI_MAX_ATTEMPTS && now >= tcp->next_attempt) {
+        if (tcpcli_next_attempt(tcp, now) == -1 && tcp->nattempt == 0) {
+            // all addresses failed
+            tcp->state = STAT_ERROR;
+            return;
+        }
+    }
+    // check if timeout
+    if (tcp->connect_timeout > 0 && (now - tcp->activity >= WTIME_FROM_SEC(tcp->connect_timeout))) { // timeout and reconnect
+        tcp->state = STAT_ERROR;
+    }
 }
 
 int tcpcli_init(struct tcpcli *tcp, float conn_timeout, float inact_timeout, float reconn_wait)
 {
     tcp->socket = INVALID_WSOCKET;
     tcp->state = STAT_ERROR;
-    tcp->activity = 0.0;
+    tcp->activity = 0;
     tcp->addr[0] = '\0';
     tcp->serv[0] = '\0';
     tcp->connect_timeout = conn_timeout;
     tcp->inactive_timeout = inact_timeout;
     tcp->reconnect_wait = reconn_wait;
+    tcp->naddr = 0;
+    tcp->next_addr = 0;
+    tcp->nattempt = 0;
+    tcp->next_attempt = 0;
+    tcp->watch = NULL;
+    tcp->watch_arg = NULL;
+    tcp->wheel = NULL;
+    wtimer_init(&tcp->timer, NULL, NULL);
+    memset(&tcp->rx, 0, sizeof(tcp->rx));
     return 0;
 }
 
 int tcpcli_open(struct tcpcli *tcp, const char *addr, int port)
 {
-    if (tcp->socket != INVALID_WSOCKET) {
+    if (tcp->socket != INVALID_WSOCKET || tcp->nattempt > 0) {
         return -1;
     }
     char serv[32];
     serv[0] = '\0';
     snprintf(serv, sizeof(serv), "%d", port);
-    wsocket sock = connect_to(addr, serv);
-    if (sock == INVALID_WSOCKET) {
+    struct resolver_addr addrs[RESOLVER_MAX_ADDR];
+    int naddr = resolver_resolve(addr, serv, SOCK_STREAM, addrs, RESOLVER_MAX_ADDR);
+    if (naddr <= 0) {
+        return -1;
+    }
+    if (tcpcli_start_connect(tcp, addrs, naddr, tcpcli_now(tcp)) == -1) {
         return -1;
     }
-    tcp->socket = sock;
-    tcp->state = STAT_CONNECTING;
-    tcp->activity = local_monotonic_clock();
     snprintf(tcp->addr, sizeof(tcp->addr), "%s", addr);
     snprintf(tcp->serv, sizeof(tcp->serv), "%s", serv);
+    tcpcli_arm(tcp);
     return 0;
 }
 
@@ -108,73 +300,150 @@ int tcpcli_isconnected(struct tcpcli *tcp)
 }
 
 
-static int tcpcli_wait(struct tcpcli *tcp)
+// close socket and connect attempts, then wait to reconnect, or stay in error
+// if never reconnect
+static void tcpcli_disconnect(struct tcpcli *tcp, int64_t now)
 {
-    if (tcp->socket == INVALID_WSOCKET && tcp->state != STAT_WAIT) {
-        return -1;
+    tcpcli_close_attempts(tcp);
+    if (tcp->socket != INVALID_WSOCKET) {
+        tcpcli_close_socket(tcp, tcp->socket);
+        tcp->socket = INVALID_WSOCKET;
     }
-    double now = local_monotonic_clock();
+    if (tcp->reconnect_wait >= 0) {
+        tcp->state = STAT_WAIT;
+        tcp->activity = now;
+    } else {
+        tcp->state = STAT_ERROR;
+    }
+}
+
+// run state machine at now
+static int tcpcli_step(struct tcpcli *tcp, int64_t now)
+{
     if (tcp->state == STAT_WAIT) { // check if wait timeout
-        if (tcp->reconnect_wait == 0 || (tcp->reconnect_wait > 0 && tcp->reconnect_wait <= (now - tcp->activity))) {
-            wsocket sock = connect_to(tcp->addr, tcp->serv);
-            if (sock == INVALID_WSOCKET) { // connect failed
-                return -1;
-            }
-            tcp->socket = sock;
-            tcp->state = STAT_CONNECTING;
+        if (tcp->reconnect_wait == 0 || (tcp->reconnect_wait > 0 && WTIME_FROM_SEC(tcp->reconnect_wait) <= (now - tcp->activity))) {
+            tcp->state = STAT_RESOLVING;
             tcp->activity = now;
         }
-    } else if (tcp->state == STAT_CONNECTING) { // check if connect or timeout
-        fd_set fds;
-        FD_ZERO(&fds);
-        FD_SET(tcp->socket, &fds);
-        struct timeval tv = {0};
-
-        int err = select(tcp->socket + 1, NULL, &fds, NULL, &tv);
-        if (err == 0) {
-            // check if timeout
-            if (tcp->connect_timeout > 0 && (now - tcp->activity >= tcp->connect_timeout)) { // timeout and reconnect
-                tcp->state = STAT_ERROR;
-            }
-        } else if (err == -1) {
-            // error
-            tcp->state = STAT_ERROR;
-        } else {
-            // check connected
-            int so_err = 0;
-            socklen_t len = sizeof(so_err);
-            if (getsockopt(tcp->socket, SOL_SOCKET, SO_ERROR, &so_err, &len) == -1 || so_err != 0) {
-                // failed
-                tcp->state = STAT_ERROR;
-            } else {
-                // OK
-                tcp->state = STAT_CONNECTED;
-                tcp->activity = now;
+    }
+    if (tcp->state == STAT_RESOLVING) { // resolve without blocking, then connect
+        struct resolver_addr addrs[RESOLVER_MAX_ADDR];
+        int naddr = resolver_lookup(tcp->addr, tcp->serv, SOCK_STREAM, addrs, RESOLVER_MAX_ADDR);
+        if (naddr > 0) {
+            if (tcpcli_start_connect(tcp, addrs, naddr, now) == -1) { // connect failed
+                tcp->state = STAT_WAIT;
+                return -1;
             }
+        } else if (naddr < 0) { // resolve failed
+            tcp->state = STAT_WAIT;
+            return -1;
+        } else if (tcp->connect_timeout > 0 && (now - tcp->activity >= WTIME_FROM_SEC(tcp->connect_timeout))) {
+            tcp->state = STAT_WAIT;
+            return -1;
         }
+    } else if (tcp->state == STAT_CONNECTING) { // check if connect or timeout
+        tcpcli_check_connect(tcp, now);
     } else if (tcp->state == STAT_CONNECTED) {
         // check if inactive
-        if (tcp->inactive_timeout > 0 && (now - tcp->activity >= tcp->inactive_timeout)) { // timeout and reconnect
+        if (tcp->inactive_timeout > 0 && (now - tcp->activity >= WTIME_FROM_SEC(tcp->inactive_timeout))) { // timeout and reconnect
             tcp->state = STAT_ERROR;
         }
     }
     if (tcp->state == STAT_ERROR) { // change to wait
+        tcpcli_disconnect(tcp, now);
         if (tcp->reconnect_wait < 0) {
             // need wait forever, so report error
-            wsocket_close(tcp->socket);
-            tcp->socket = INVALID_WSOCKET;
             return -1;
         }
-        wsocket_close(tcp->socket);
-        tcp->socket = INVALID_WSOCKET;
-        tcp->state = STAT_WAIT;
-        tcp->activity = now;
     }
     return 0;
 }
 
+static int tcpcli_wait(struct tcpcli *tcp)
+{
+    if (tcp->socket == INVALID_WSOCKET && tcp->state == STAT_ERROR) {
+        return -1;
+    }
+    int rv = tcpcli_step(tcp, tcpcli_now(tcp));
+    tcpcli_arm(tcp);
+    return rv;
+}
+
+// default timer callback
+static void tcpcli_on_timer(struct wtimer *timer, void *arg)
+{
+    (void)timer;
+    tcpcli_wait(arg);
+}
+
+void tcpcli_reset(struct tcpcli *tcp)
+{
+    if (tcp->state == STAT_CONNECTED || tcp->state == STAT_CONNECTING) {
+        // same as a failed connection, socket must not stay invalid in
+        // STAT_ERROR, or tcpcli_wait takes it as closed
+        tcpcli_disconnect(tcp, tcpcli_now(tcp));
+        tcpcli_arm(tcp);
+    }
+}
+
+int tcpcli_update(struct tcpcli *tcp)
+{
+    return tcpcli_wait(tcp);
+}
+
+// recv into buff until socket is empty or buff is full, connection error is
+// recorded in state. return bytes received.
+static size_t tcpcli_recv_all(struct tcpcli *tcp, char *p, size_t count)
+{
+    if (count > INT_MAX) {
+        count = INT_MAX;
+    }
+    size_t total = 0;
+    while (total < count) {
+        size_t want = count - total;
+        int rv = recv(tcp->socket, p + total, want, 0);
+        if (rv > 0) {
+            total += rv;
+            if ((size_t)rv < want) {
+                // short read of stream socket means receive queue is empty,
+                // new data makes a new edge, no need to wait for EAGAIN
+                break;
+            }
+            continue;
+        }
+        if (rv == -1 && wsocket_errno == WSOCKET_EINTR) {
+            continue;
+        }
+        if (rv == 0 || wsocket_errno != WSOCKET_EWOULDBLOCK) {
+            tcp->state = STAT_ERROR;
+            tcpcli_arm(tcp);
+        }
+        break;
+    }
+    return total;
+}
+
+// copy data left in receive ring, return bytes copied.
+static int tcpcli_read_ring(struct tcpcli *tcp, void *buff, size_t count)
+{
+    size_t len = 0;
+    const void *data = wring_peek(&tcp->rx, &len);
+    if (count > len) {
+        count = len;
+    }
+    if (count > INT_MAX) {
+        count = INT_MAX;
+    }
+    memcpy(buff, data, count);
+    wring_consume(&tcp->rx, count);
+    return count;
+}
+
 int tcpcli_read(struct tcpcli *tcp, void *buff, size_t count)
 {
+    if (tcp->rx.len > 0) {
+        return tcpcli_read_ring(tcp, buff, count);
+    }
     if (tcpcli_wait(tcp) != 0) {
         return -1;
     }
@@ -182,15 +451,76 @@ int tcpcli_read(struct tcpcli *tcp, void *buff, size_t count)
         int rv = recv(tcp->socket, buff, count, 0);
         if ((rv == -1 && wsocket_errno != WSOCKET_EWOULDBLOCK) || rv == 0) {
             tcp->state = STAT_ERROR;
+            tcpcli_arm(tcp);
         }
         if (rv > 0) {
-            tcp->activity = local_monotonic_clock();
+            tcp->activity = tcpcli_now(tcp);
             return rv;
         }
     }
     return 0;
 }
 
+int tcpcli_drain(struct tcpcli *tcp, void *buff, size_t count)
+{
+    if (tcp->rx.len > 0) {
+        return tcpcli_read_ring(tcp, buff, count);
+    }
+    if (tcpcli_wait(tcp) != 0) {
+        return -1;
+    }
+    if (tcp->state != STAT_CONNECTED) {
+        return 0;
+    }
+    size_t total = tcpcli_recv_all(tcp, buff, count);
+    if (total > 0) {
+        tcp->activity = tcpcli_now(tcp);
+    }
+    return total;
+}
+
+int tcpcli_set_rxring(struct tcpcli *tcp, size_t size)
+{
+    wring_free(&tcp->rx);
+    if (size == 0) {
+        return 0;
+    }
+    return wring_init(&tcp->rx, size);
+}
+
+int tcpcli_peek(struct tcpcli *tcp, const void **ptr, size_t *len)
+{
+    if (tcp->rx.buf == NULL) {
+        return -1;
+    }
+    if (tcpcli_wait(tcp) != 0 && tcp->rx.len == 0) {
+        return -1;
+    }
+    if (tcp->state == STAT_CONNECTED) {
+        size_t total = 0;
+        size_t avail = 0;
+        char *p;
+        while (tcp->state == STAT_CONNECTED && (p = wring_write_ptr(&tcp->rx, &avail)) != NULL) {
+            size_t n = tcpcli_recv_all(tcp, p, avail);
+            wring_commit(&tcp->rx, n);
+            total += n;
+            if (n < avail) {
+                break;
+            }
+        }
+        if (total > 0) {
+            tcp->activity = tcpcli_now(tcp);
+        }
+    }
+    *ptr = wring_peek(&tcp->rx, len);
+    return *len > INT_MAX ? INT_MAX : (int)*len;
+}
+
+void tcpcli_consume(struct tcpcli *tcp, size_t n)
+{
+    wring_consume(&tcp->rx, n);
+}
+
 int tcpcli_write(struct tcpcli *tcp, const void *data, size_t count)
 {
     if (tcpcli_wait(tcp) != 0) {
@@ -200,6 +530,25 @@ int tcpcli_write(struct tcpcli *tcp, const void *data, size_t count)
         int sd = send(tcp->socket, data, count, 0);
         if ((sd == -1 && wsocket_errno != WSOCKET_EWOULDBLOCK) || sd == 0) {
             tcp->state = STAT_ERROR;
+            tcpcli_arm(tcp);
+        }
+        if (sd > 0) {
+            return sd;
+        }
+    }
+    return 0;
+}
+
+int tcpcli_writev(struct tcpcli *tcp, const wsocket_iovec *iov, int iovcnt)
+{
+    if (tcpcli_wait(tcp) != 0) {
+        return -1;
+    }
+    if (tcp->state == STAT_CONNECTED) {
+        int sd = wsocket_sendv(tcp->socket, iov, iovcnt);
+        if ((sd == -1 && wsocket_errno != WSOCKET_EWOULDBLOCK) || sd == 0) {
+            tcp->state = STAT_ERROR;
+            tcpcli_arm(tcp);
         }
         if (sd > 0) {
             return sd;
@@ -208,10 +557,51 @@ int tcpcli_write(struct tcpcli *tcp, const void *data, size_t count)
     return 0;
 }
 
+void tcpcli_set_watcher(struct tcpcli *tcp, tcpcli_watch_cb cb, void *arg)
+{
+    tcp->watch = cb;
+    tcp->watch_arg = arg;
+    if (cb) {
+        // report sockets already open
+        for (int i = 0; i < tcp->nattempt; i++) {
+            tcpcli_watch(tcp, tcp->attempts[i], TCPCLI_EV_WRITE);
+        }
+        tcpcli_watch(tcp, tcp->socket, TCPCLI_EV_READ);
+    }
+}
+
+void tcpcli_set_timer(struct tcpcli *tcp, struct wtimer_wheel *wheel, wtimer_cb cb, void *arg)
+{
+    if (tcp->wheel) {
+        wtimer_del(tcp->wheel, &tcp->timer);
+    }
+    tcp->wheel = wheel;
+    if (cb) {
+        wtimer_init(&tcp->timer, cb, arg);
+    } else {
+        wtimer_init(&tcp->timer, tcpcli_on_timer, tcp);
+    }
+    tcpcli_arm(tcp);
+}
+
+void tcpcli_notify(struct tcpcli *tcp, wsocket sock, int events)
+{
+    if (tcp->state != STAT_CONNECTING || events == 0) {
+        return;
+    }
+    for (int i = 0; i < tcp->nattempt; i++) {
+        if (tcp->attempts[i] == sock) {
+            tcpcli_attempt_done(tcp, i, tcpcli_now(tcp));
+            tcpcli_arm(tcp);
+            return;
+        }
+    }
+}
+
 double tcpcli_last_activity(struct tcpcli *tcp)
 {
     if (tcp) {
-        return local_monotonic_clock() - tcp->activity;
+        return WTIME_TO_SEC(tcpcli_now(tcp) - tcp->activity);
     } else {
         return -1;
     }
@@ -219,13 +609,21 @@ double tcpcli_last_activity(struct tcpcli *tcp)
 
 int tcpcli_close(struct tcpcli *tcp)
 {
+    if (tcp->wheel) {
+        wtimer_del(tcp->wheel, &tcp->timer);
+    }
+    wring_free(&tcp->rx);
+    // also stop connecting or resolving, not only a connected socket
+    tcpcli_close_attempts(tcp);
     if (tcp->socket != INVALID_WSOCKET) {
-        wsocket_close(tcp->socket);
+        tcpcli_close_socket(tcp, tcp->socket);
         tcp->socket = INVALID_WSOCKET;
-        tcp->state = STAT_ERROR;
-        tcp->activity = 0;
-        tcp->addr[0] = '\0';
-        tcp->serv[0] = '\0';
     }
+    tcp->state = STAT_ERROR;
+    tcp->activity = 0;
+    tcp->naddr = 0;
+    tcp->next_addr = 0;
+    tcp->addr[0] = '\0';
+    tcp->serv[0] = '\0';
     return 0;
 }
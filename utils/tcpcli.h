@@ -2,11 +2,31 @@
 #define TCPCLI_H
 
 #include "../wsocket.h"
+#include "resolver.h"
+#include "wtimer.h"
+#include "wring.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// max parallel connect attempts
+#define TCPCLI_MAX_ATTEMPTS     4
+// delay before starting next connect attempt, in seconds
+#define TCPCLI_ATTEMPT_DELAY    0.25
+
+// socket events of tcpcli watcher
+enum {
+    TCPCLI_EV_READ  = 0x01,
+    TCPCLI_EV_WRITE = 0x02,
+};
+
+struct tcpcli;
+
+// external watcher, called when tcpcli wants events of sock, events 0 means
+// sock is about to be closed and should be unregistered.
+typedef void (*tcpcli_watch_cb)(struct tcpcli *tcp, wsocket sock, int events, void *arg);
+
 // tcp client object
 // use it to recv/send remote tcp server data
 // it will auto reconnect if error detect
@@ -14,7 +34,7 @@ struct tcpcli {
     wsocket socket;
 
     int state;
-    double activity;
+    int64_t activity;       // time of last activity, in nanoseconds, see wtime.h
 
     char addr[64];
     char serv[32];
@@ -23,6 +43,22 @@ struct tcpcli {
     float inactive_timeout; // recv inactive timeout, in seconds. <= 0 means forever.
     float reconnect_wait;   // wait time before start reconnect. 0 means no wait.
                             // < 0 means wait forever, this makes tcpcli one shot connection.
+
+    // connect attempts, raced across resolved addresses (happy eyeballs)
+    struct resolver_addr addrs[RESOLVER_MAX_ADDR];
+    int naddr;
+    int next_addr;
+    wsocket attempts[TCPCLI_MAX_ATTEMPTS];
+    int nattempt;
+    int64_t next_attempt;
+
+    tcpcli_watch_cb watch;  // external watcher, NULL means poll sockets itself
+    void *watch_arg;
+
+    struct wtimer_wheel *wheel; // timer wheel, NULL means take time from wtime_now
+    struct wtimer timer;        // next deadline of current state
+
+    struct wring rx;            // receive ring, see tcpcli_set_rxring
 };
 
 // init tcpcli object
@@ -32,25 +68,84 @@ int tcpcli_init(struct tcpcli *tcp, float conn_timeout, float inact_timeout, flo
 // open tcpcli object, to connect to remote addr:port
 // return 0 in success, -1 in error, it will not auto reconnect when return error.
 // it will connect remote in non-blocking mode, and
-// timeout limit is connect_timeout
+// timeout limit is connect_timeout.
+// if addr resolves to several addresses, a new connect attempt is started every
+// TCPCLI_ATTEMPT_DELAY while previous ones are pending, first connected one wins.
 int tcpcli_open(struct tcpcli *tcp, const char *addr, int port);
 
 // check if tcpcli object is connected
 // return 1 means connected, otherwise 0 not connected
 int tcpcli_isconnected(struct tcpcli *tcp);
 
+// drop current connection or connect attempts, as on connection error, so
+// it reconnects after reconnect_wait. useful on protocol errors.
+void tcpcli_reset(struct tcpcli *tcp);
+
+// run connection state machine without reading or writing: reconnect,
+// connect and inactive timeouts. tcpcli_read/tcpcli_write do this too.
+// return -1 in error, same as tcpcli_read, otherwise 0.
+int tcpcli_update(struct tcpcli *tcp);
+
 // read data from tcpcli object, in non-blocking mode.
 // return -1 in error, otherwise return bytes count has read.
 // it will auto reconnect in connection error and not return -1 if reconnect_wait >= 0.
 // if reconnect_wait < 0, it will return -1 either connection error or in wating
 int tcpcli_read(struct tcpcli *tcp, void *buff, size_t count);
 
+// read data until socket has no more or buff of count bytes is full, for
+// edge-triggered notifiers and high rate streams. state machine is checked
+// and activity is updated once per call.
+// return -1 in error, otherwise return bytes count has read. if it equals
+// count, more data may be pending and caller should call it again.
+// reconnect behavior is same as tcpcli_read, data read before connection
+// error is returned first.
+int tcpcli_drain(struct tcpcli *tcp, void *buff, size_t count);
+
+// enable receive ring of at least size bytes for tcpcli_peek, 0 to disable.
+// data left in ring is returned first by tcpcli_read and tcpcli_drain, and is
+// dropped when a new connection is made. tcpcli_close frees it.
+// return 0 on success, -1 on error.
+int tcpcli_set_rxring(struct tcpcli *tcp, size_t size);
+
+// receive into ring until it is full or socket has no more, then get all
+// unconsumed data in one contiguous block without copy, ptr and len are set
+// to it. data stays until tcpcli_consume, ptr is valid until next call.
+// return -1 in error or ring not enabled, otherwise return len.
+// reconnect behavior is same as tcpcli_read, data received before connection
+// error is still returned.
+int tcpcli_peek(struct tcpcli *tcp, const void **ptr, size_t *len);
+
+// drop n bytes from front of received data, after parsing them in place.
+void tcpcli_consume(struct tcpcli *tcp, size_t n);
+
 // write data to tcpcli object, in non-blocking mode
 // return -1 in error, otherwise return bytes count has written
 // it will auto reconnect in connection error and not return -1 if reconnect_wait >= 0.
 // if reconnect_wait < 0, it will return -1 either connection error or in wating
 int tcpcli_write(struct tcpcli *tcp, const void *data, size_t count);
 
+// same as tcpcli_write, data is gathered from iovcnt buffers in one send.
+// return -1 in error, otherwise return bytes count has written, which may be
+// less than total size of buffers.
+int tcpcli_writev(struct tcpcli *tcp, const wsocket_iovec *iov, int iovcnt);
+
+// set external watcher, so tcpcli can be driven by a readiness notifier such as
+// a shared epoll instance. sockets opened before this call are reported at once.
+// with watcher set, tcpcli does not poll connect attempts itself, they are
+// finished by tcpcli_notify. NULL means poll sockets itself, works with any
+// socket value.
+void tcpcli_set_watcher(struct tcpcli *tcp, tcpcli_watch_cb cb, void *arg);
+
+// attach tcp to timer wheel, NULL to detach. connect, inactive and reconnect
+// deadlines are kept as one timer in wheel, and tcp takes wheel time as
+// current time instead of reading clock, so wheel should run on
+// wtimer_clock_ms. when timer expires cb is called with arg, it should call
+// tcpcli_update. NULL cb means call tcpcli_update directly.
+void tcpcli_set_timer(struct tcpcli *tcp, struct wtimer_wheel *wheel, wtimer_cb cb, void *arg);
+
+// report events of sock from external readiness notifier, events is
+// TCPCLI_EV_XXX, error or hangup should be reported as TCPCLI_EV_WRITE.
+void tcpcli_notify(struct tcpcli *tcp, wsocket sock, int events);
 
 // get elpased seconds since last activity, < 0 means error.
 // activity means state change or has read some data.
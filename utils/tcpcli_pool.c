@@ -0,0 +1,230 @@
+#include "tcpcli_pool.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+// max events handled in one tcpcli_pool_run, others are reported by next call
+#define POLL_EVENTS 256
+
+int tcpcli_pool_init(struct tcpcli_pool *pool)
+{
+    pool->evfd = -1;
+    pool->conns = NULL;
+    pool->cap = 0;
+    pool->count = 0;
+    pool->free_head = -1;
+    wtimer_wheel_init(&pool->wheel, wtimer_clock_ms());
+#ifdef __linux__
+    pool->evfd = epoll_create1(EPOLL_CLOEXEC);
+#endif
+    return pool->evfd == -1 ? -1 : 0;
+}
+
+#ifdef __linux__
+// epoll event data: socket in low 32 bits, then slot index and generation
+static uint64_t ev_data(const struct tcpcli_pool_conn *conn, wsocket sock)
+{
+    return (uint32_t)sock | ((uint64_t)(conn->id & 0xffffff) << 32) | ((uint64_t)(conn->gen & 0xff) << 56);
+}
+
+// timer of connection expired
+static void pool_timer(struct wtimer *timer, void *arg)
+{
+    (void)timer;
+    struct tcpcli_pool_conn *conn = arg;
+    if (tcpcli_update(conn->tcp) == -1) {
+        // let owner see the error by reading
+        conn->cb(conn->pool, conn->tcp, TCPCLI_POOL_READ, conn->arg);
+    }
+}
+
+static void pool_watch(struct tcpcli *tcp, wsocket sock, int events, void *arg)
+{
+    (void)tcp;
+    struct tcpcli_pool_conn *conn = arg;
+    int evfd = conn->pool->evfd;
+    // registered already, so one epoll_ctl per change
+    int i = 0;
+    while (i < conn->nwatched && conn->watched[i] != sock) {
+        i++;
+    }
+    if (events == 0) {
+        if (i < conn->nwatched) {
+            epoll_ctl(evfd, EPOLL_CTL_DEL, sock, NULL);
+            conn->watched[i] = conn->watched[--conn->nwatched];
+        }
+        return;
+    }
+    struct epoll_event ev = {0};
+    ev.events = ((events & TCPCLI_EV_READ) ? EPOLLIN : 0) | ((events & TCPCLI_EV_WRITE) ? EPOLLOUT : 0);
+    ev.data.u64 = ev_data(conn, sock);
+    if (i < conn->nwatched) {
+        epoll_ctl(evfd, EPOLL_CTL_MOD, sock, &ev);
+    } else if (conn->nwatched < TCPCLI_MAX_ATTEMPTS + 1 &&
+               epoll_ctl(evfd, EPOLL_CTL_ADD, sock, &ev) == 0) {
+        conn->watched[conn->nwatched++] = sock;
+    }
+}
+#endif
+
+// grow slots, return 0 on success, -1 on error.
+static int pool_grow(struct tcpcli_pool *pool)
+{
+    int cap = pool->cap < 16 ? 16 : pool->cap * 2;
+    if (cap > 0xffffff) {
+        return -1;
+    }
+    struct tcpcli_pool_conn **conns = realloc(pool->conns, cap * sizeof(*conns));
+    if (conns == NULL) {
+        return -1;
+    }
+    pool->conns = conns;
+    for (int i = pool->cap; i < cap; i++) {
+        conns[i] = NULL;
+    }
+    for (int i = cap - 1; i >= pool->cap; i--) {
+        conns[i] = calloc(1, sizeof(struct tcpcli_pool_conn));
+        if (conns[i] == NULL) {
+            // keep slots allocated so far
+            for (int j = i + 1; j < cap; j++) {
+                free(conns[j]);
+                conns[j] = NULL;
+            }
+            return -1;
+        }
+    }
+    for (int i = cap - 1; i >= pool->cap; i--) {
+        conns[i]->pool = pool;
+        conns[i]->id = i;
+        conns[i]->next_free = pool->free_head;
+        pool->free_head = i;
+    }
+    pool->cap = cap;
+    return 0;
+}
+
+int tcpcli_pool_add(struct tcpcli_pool *pool, struct tcpcli *tcp, tcpcli_pool_cb cb, void *arg)
+{
+#ifdef __linux__
+    if (pool->evfd == -1 || tcp->watch != NULL) {
+        return -1;
+    }
+    if (pool->free_head == -1 && pool_grow(pool) == -1) {
+        return -1;
+    }
+    struct tcpcli_pool_conn *conn = pool->conns[pool->free_head];
+    pool->free_head = conn->next_free;
+    conn->tcp = tcp;
+    conn->cb = cb;
+    conn->arg = arg;
+    conn->next_free = -1;
+    conn->nwatched = 0;
+    pool->count++;
+    tcpcli_set_watcher(tcp, pool_watch, conn);
+    tcpcli_set_timer(tcp, &pool->wheel, pool_timer, conn);
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+int tcpcli_pool_remove(struct tcpcli_pool *pool, struct tcpcli *tcp)
+{
+#ifdef __linux__
+    if (tcp->watch != pool_watch) {
+        return -1;
+    }
+    struct tcpcli_pool_conn *conn = tcp->watch_arg;
+    if (conn->pool != pool) {
+        return -1;
+    }
+    for (int i = 0; i < conn->nwatched; i++) {
+        epoll_ctl(pool->evfd, EPOLL_CTL_DEL, conn->watched[i], NULL);
+    }
+    conn->nwatched = 0;
+    tcpcli_set_watcher(tcp, NULL, NULL);
+    tcpcli_set_timer(tcp, NULL, NULL, NULL);
+    conn->tcp = NULL;
+    conn->cb = NULL;
+    conn->arg = NULL;
+    conn->gen++;
+    conn->next_free = pool->free_head;
+    pool->free_head = conn->id;
+    pool->count--;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+int tcpcli_pool_run(struct tcpcli_pool *pool, int timeout)
+{
+#ifdef __linux__
+    if (pool->evfd == -1) {
+        return -1;
+    }
+    int wait = wtimer_next(&pool->wheel, wtimer_clock_ms());
+    if (timeout >= 0 && (wait < 0 || timeout < wait)) {
+        wait = timeout;
+    }
+    struct epoll_event evs[POLL_EVENTS];
+    int n = epoll_wait(pool->evfd, evs, POLL_EVENTS, wait);
+    if (n == -1 && errno != EINTR) {
+        return -1;
+    }
+    // timers first, so events see fresh wheel time
+    int cnt = wtimer_advance(&pool->wheel, wtimer_clock_ms());
+    for (int i = 0; i < n; i++) {
+        uint64_t data = evs[i].data.u64;
+        wsocket sock = (wsocket)(uint32_t)data;
+        int id = (data >> 32) & 0xffffff;
+        if (id >= pool->cap) {
+            continue;
+        }
+        struct tcpcli_pool_conn *conn = pool->conns[id];
+        if (conn->tcp == NULL || (conn->gen & 0xff) != (data >> 56)) {
+            continue; // removed in this round
+        }
+        struct tcpcli *tcp = conn->tcp;
+        if (sock != tcp->socket) {
+            // connect attempt finished
+            tcpcli_notify(tcp, sock, TCPCLI_EV_WRITE);
+            if (tcpcli_isconnected(tcp)) {
+                conn->cb(pool, tcp, TCPCLI_POOL_WRITE, conn->arg);
+                cnt++;
+            }
+        } else if (evs[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            conn->cb(pool, tcp, TCPCLI_POOL_READ, conn->arg);
+            cnt++;
+        }
+    }
+    return cnt;
+#else
+    return -1;
+#endif
+}
+
+int tcpcli_pool_close(struct tcpcli_pool *pool)
+{
+    for (int i = 0; i < pool->cap; i++) {
+        if (pool->conns[i]->tcp) {
+            tcpcli_pool_remove(pool, pool->conns[i]->tcp);
+        }
+        free(pool->conns[i]);
+    }
+    free(pool->conns);
+    pool->conns = NULL;
+    pool->cap = 0;
+    pool->count = 0;
+    pool->free_head = -1;
+#ifdef __linux__
+    if (pool->evfd != -1) {
+        close(pool->evfd);
+        pool->evfd = -1;
+    }
+#endif
+    return 0;
+}
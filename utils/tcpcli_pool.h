@@ -0,0 +1,69 @@
+#ifndef TCPCLI_POOL_H
+#define TCPCLI_POOL_H
+
+#include "tcpcli.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// events passed to pool callback
+enum {
+    TCPCLI_POOL_READ  = 0x01, // data or hangup pending, call tcpcli_read
+    TCPCLI_POOL_WRITE = 0x02, // connection established, ready to write
+};
+
+struct tcpcli_pool;
+
+// called when tcp in pool has events, TCPCLI_POOL_XXX
+typedef void (*tcpcli_pool_cb)(struct tcpcli_pool *pool, struct tcpcli *tcp, int events, void *arg);
+
+// connection slot in pool
+struct tcpcli_pool_conn {
+    struct tcpcli_pool *pool;
+    struct tcpcli *tcp;     // NULL if slot is free
+    tcpcli_pool_cb cb;
+    void *arg;
+    int id;                 // slot index
+    unsigned int gen;       // bumped when slot is freed, drops stale events
+    int next_free;
+    wsocket watched[TCPCLI_MAX_ATTEMPTS + 1]; // sockets registered in epoll
+    int nwatched;
+};
+
+// pool of tcpcli objects driven by one epoll instance (linux only).
+// readiness is dispatched to callbacks, reconnect and timeouts are timers in
+// one wheel, so idle connections cost no syscalls and no clock reads.
+struct tcpcli_pool {
+    int evfd;
+    struct tcpcli_pool_conn **conns; // slots, allocated one by one so
+                                     // watcher args stay valid
+    int cap;
+    int count;
+    int free_head;
+    struct wtimer_wheel wheel;
+};
+
+// init pool, return 0 on success, -1 on error.
+int tcpcli_pool_init(struct tcpcli_pool *pool);
+
+// add opened tcp to pool, cb is called with arg on events.
+// tcp is still owned by caller, remove it before close.
+// return 0 on success, -1 on error.
+int tcpcli_pool_add(struct tcpcli_pool *pool, struct tcpcli *tcp, tcpcli_pool_cb cb, void *arg);
+
+// remove tcp from pool, return 0 on success, -1 if not in pool.
+int tcpcli_pool_remove(struct tcpcli_pool *pool, struct tcpcli *tcp);
+
+// wait for events at most timeout milliseconds (< 0 means forever) or until
+// next timer, dispatch them to callbacks and run expired timers.
+// return events and timers handled count, -1 on error.
+int tcpcli_pool_run(struct tcpcli_pool *pool, int timeout);
+
+// remove all connections and free pool, always return 0.
+int tcpcli_pool_close(struct tcpcli_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // TCPCLI_POOL_H
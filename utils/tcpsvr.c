@@ -1,8 +1,17 @@
 #include "tcpsvr.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-static wsocket listen_on(const char *addr, const char* service)
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+// epoll event data of listen socket, clients use their index
+#define EV_LISTEN   ((unsigned int)-1)
+
+static wsocket listen_on(const char *addr, const char* service, int backlog, int reuseport)
 {
     wsocket sock = INVALID_WSOCKET;
 
@@ -23,15 +32,30 @@ static wsocket listen_on(const char *addr, const char* service)
 #else
         sock = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
 #endif
+        if (sock == INVALID_WSOCKET) {
+            continue;
+        }
         if (wsocket_set_nonblocking(sock) == WSOCKET_ERROR) {
             wsocket_close(sock);
+            freeaddrinfo(ai);
             return INVALID_WSOCKET;
         }
-        if (sock == INVALID_WSOCKET) {
-            continue;
-        }
         // enable addr resuse
         setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&(int){1}, sizeof(int));
+#ifdef SO_REUSEPORT
+        if (reuseport &&
+            setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (const char *)&(int){1}, sizeof(int)) == WSOCKET_ERROR) {
+            wsocket_close(sock);
+            sock = INVALID_WSOCKET;
+            continue;
+        }
+#else
+        if (reuseport) {
+            wsocket_close(sock);
+            freeaddrinfo(ai);
+            return INVALID_WSOCKET;
+        }
+#endif
         if (bind(sock, p->ai_addr, p->ai_addrlen) == WSOCKET_ERROR) {
             // bind error
             wsocket_close(sock);
@@ -51,36 +75,363 @@ static wsocket listen_on(const char *addr, const char* service)
     freeaddrinfo(ai);
     ai = NULL;
 
-    if (listen(sock, 2) == WSOCKET_ERROR) {
+    if (listen(sock, backlog) == WSOCKET_ERROR) {
         wsocket_close(sock);
         return INVALID_WSOCKET;
     }
     return sock;
 }
 
-int tcpsvr_init(struct tcpsvr *svr, int readflag)
+int tcpsvr_init(struct tcpsvr *svr, int readflag, int max_cli)
 {
     svr->socket = INVALID_WSOCKET;
-    for (int i = 0; i < TCPSVR_MAX_CLI; i++) {
-        svr->clients[i] = INVALID_WSOCKET;
-    }
+    svr->clients = NULL;
+    svr->cap = 0;
+    svr->max_cli = max_cli > 0 ? max_cli : TCPSVR_MAX_CLI;
+    svr->nclients = 0;
+    svr->free_head = -1;
+    svr->head = -1;
+    svr->tail = -1;
     if (readflag >= TCPSVR_READ_NONE && readflag <= TCPSVR_READ_EVERY) {
         svr->read = readflag;
     } else {
         svr->read = TCPSVR_READ_ONLYONE;
     }
-    svr->idx = 0;
+    svr->cursor = -1;
+    svr->accept_budget = TCPSVR_ACCEPT_BUDGET;
+    svr->queue_max = TCPSVR_QUEUE_MAX;
+    svr->overflow = TCPSVR_OVERFLOW_DROP;
+    svr->block_timeout = TCPSVR_BLOCK_TIMEOUT;
+    svr->evfd = -1;
+    svr->evmode = 0;
+    svr->readyq = NULL;
+    svr->nready = 0;
+    svr->ready_idx = 0;
+    svr->close_cb = NULL;
+    svr->close_arg = NULL;
+    return 0;
+}
+
+static void tcpsvr_ev_add(struct tcpsvr *svr, wsocket sock, unsigned int data)
+{
+#ifdef __linux__
+    if (svr->evfd != -1) {
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN;
+        ev.data.u32 = data;
+        epoll_ctl(svr->evfd, EPOLL_CTL_ADD, sock, &ev);
+    }
+#endif
+}
+
+// register writable event if client has queued data
+static void tcpsvr_ev_update(struct tcpsvr *svr, int idx)
+{
+    struct tcpsvr_client *cli = &svr->clients[idx];
+    int evout = cli->oq.count > 0;
+    if (evout == cli->evout) {
+        return;
+    }
+    cli->evout = evout;
+#ifdef __linux__
+    if (svr->evfd != -1) {
+        struct epoll_event ev = {0};
+        ev.events = evout ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        ev.data.u32 = idx;
+        epoll_ctl(svr->evfd, EPOLL_CTL_MOD, cli->socket, &ev);
+    }
+#endif
+}
+
+static void tcpsvr_ev_del(struct tcpsvr *svr, wsocket sock)
+{
+#ifdef __linux__
+    if (svr->evfd != -1) {
+        epoll_ctl(svr->evfd, EPOLL_CTL_DEL, sock, NULL);
+    }
+#endif
+}
+
+// create epoll instance and register listen socket and current clients, on
+// first tcpsvr_poll only, so callers never polling make no epoll calls.
+// select is used if it fails.
+static void tcpsvr_ev_start(struct tcpsvr *svr)
+{
+#ifdef __linux__
+    svr->evfd = epoll_create1(EPOLL_CLOEXEC);
+    if (svr->evfd == -1) {
+        return;
+    }
+    tcpsvr_ev_add(svr, svr->socket, EV_LISTEN);
+    for (int i = svr->head; i != -1; i = svr->clients[i].next) {
+        struct tcpsvr_client *cli = &svr->clients[i];
+        struct epoll_event ev = {0};
+        ev.events = cli->evout ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        ev.data.u32 = i;
+        epoll_ctl(svr->evfd, EPOLL_CTL_ADD, cli->socket, &ev);
+    }
+#else
+    (void)svr;
+#endif
+}
+
+// atomic reference count, messages may be shared across threads
+#if defined(__GNUC__) || defined(__clang__)
+#define MSG_REF(msg)    __atomic_add_fetch(&(msg)->refcnt, 1, __ATOMIC_RELAXED)
+#define MSG_UNREF(msg)  __atomic_sub_fetch(&(msg)->refcnt, 1, __ATOMIC_ACQ_REL)
+#elif defined(_WIN32)
+#define MSG_REF(msg)    InterlockedIncrement(&(msg)->refcnt)
+#define MSG_UNREF(msg)  InterlockedDecrement(&(msg)->refcnt)
+#else
+#define MSG_REF(msg)    (++(msg)->refcnt)
+#define MSG_UNREF(msg)  (--(msg)->refcnt)
+#endif
+
+struct tcpsvr_msg {
+#ifdef _WIN32
+    volatile long refcnt;
+#else
+    int    refcnt;
+#endif
+    size_t len;
+    unsigned char data[];
+};
+
+struct tcpsvr_msg *tcpsvr_msg_new(const void *data, size_t count)
+{
+    struct tcpsvr_msg *msg = malloc(sizeof(*msg) + count);
+    if (msg == NULL) {
+        return NULL;
+    }
+    msg->refcnt = 1;
+    msg->len = count;
+    if (data) {
+        memcpy(msg->data, data, count);
+    }
+    return msg;
+}
+
+void *tcpsvr_msg_data(struct tcpsvr_msg *msg)
+{
+    return msg->data;
+}
+
+size_t tcpsvr_msg_size(const struct tcpsvr_msg *msg)
+{
+    return msg->len;
+}
+
+struct tcpsvr_msg *tcpsvr_msg_ref(struct tcpsvr_msg *msg)
+{
+    MSG_REF(msg);
+    return msg;
+}
+
+void tcpsvr_msg_release(struct tcpsvr_msg *msg)
+{
+    if (msg && MSG_UNREF(msg) == 0) {
+        free(msg);
+    }
+}
+
+// append msg to queue, queue takes the reference. return 0 on success, -1 on error.
+static int queue_push(struct tcpsvr_queue *q, struct tcpsvr_msg *msg)
+{
+    if (q->count == q->cap) {
+        int cap = q->cap ? q->cap * 2 : 8;
+        struct tcpsvr_msg **msgs = malloc(cap * sizeof(*msgs));
+        if (msgs == NULL) {
+            return -1;
+        }
+        for (int i = 0; i < q->count; i++) {
+            msgs[i] = q->msgs[(q->head + i) & (q->cap - 1)];
+        }
+        free(q->msgs);
+        q->msgs = msgs;
+        q->cap = cap;
+        q->head = 0;
+    }
+    q->msgs[(q->head + q->count) & (q->cap - 1)] = msg;
+    q->count++;
+    q->bytes += msg->len;
+    if (q->bytes > q->peak) {
+        q->peak = q->bytes;
+    }
     return 0;
 }
 
+// remove head message
+static void queue_pop(struct tcpsvr_queue *q)
+{
+    struct tcpsvr_msg *msg = q->msgs[q->head];
+    q->bytes -= msg->len - q->offset;
+    q->offset = 0;
+    q->head = (q->head + 1) & (q->cap - 1);
+    q->count--;
+    tcpsvr_msg_release(msg);
+}
+
+// remove oldest message not partially sent, return 0 on success, -1 if none.
+static int queue_drop_oldest(struct tcpsvr_queue *q)
+{
+    if (q->count == 0 || (q->count == 1 && q->offset > 0)) {
+        return -1;
+    }
+    if (q->offset > 0) {
+        // keep head in flight, drop the one after it
+        int second = (q->head + 1) & (q->cap - 1);
+        struct tcpsvr_msg *msg = q->msgs[second];
+        q->msgs[second] = q->msgs[q->head];
+        q->head = second;
+        q->count--;
+        q->bytes -= msg->len;
+        tcpsvr_msg_release(msg);
+    } else {
+        queue_pop(q);
+    }
+    q->dropped++;
+    return 0;
+}
+
+static void queue_clear(struct tcpsvr_queue *q)
+{
+    while (q->count > 0) {
+        queue_pop(q);
+    }
+    free(q->msgs);
+    memset(q, 0, sizeof(*q));
+}
+
+// grow client slab, return 0 on success, -1 if limit reached or no memory.
+static int tcpsvr_grow(struct tcpsvr *svr)
+{
+    if (svr->cap >= svr->max_cli) {
+        return -1;
+    }
+    int cap = svr->cap < 16 ? 16 : svr->cap * 2;
+    if (cap > svr->max_cli) {
+        cap = svr->max_cli;
+    }
+    struct tcpsvr_client *clients = realloc(svr->clients, cap * sizeof(*clients));
+    if (clients == NULL) {
+        return -1;
+    }
+    svr->clients = clients;
+    int *readyq = realloc(svr->readyq, cap * sizeof(*readyq));
+    if (readyq == NULL) {
+        return -1;
+    }
+    svr->readyq = readyq;
+    // push new slots to free list, lowest index first
+    for (int i = cap - 1; i >= svr->cap; i--) {
+        clients[i].socket = INVALID_WSOCKET;
+        clients[i].prev = -1;
+        clients[i].next = svr->free_head;
+        clients[i].ready = 0;
+        clients[i].evout = 0;
+        clients[i].closing = 0;
+        memset(&clients[i].oq, 0, sizeof(clients[i].oq));
+        svr->free_head = i;
+    }
+    svr->cap = cap;
+    return 0;
+}
+
+// take a free slot for sock and link it to valid list tail, return index or -1.
+static int tcpsvr_add_client(struct tcpsvr *svr, wsocket sock)
+{
+    if (svr->free_head == -1 && tcpsvr_grow(svr) == -1) {
+        return -1;
+    }
+    int idx = svr->free_head;
+    struct tcpsvr_client *cli = &svr->clients[idx];
+    svr->free_head = cli->next;
+    cli->socket = sock;
+    cli->ready = 0;
+    cli->evout = 0;
+    cli->closing = 0;
+    cli->prev = svr->tail;
+    cli->next = -1;
+    if (svr->tail != -1) {
+        svr->clients[svr->tail].next = idx;
+    } else {
+        svr->head = idx;
+    }
+    svr->tail = idx;
+    svr->nclients++;
+    return idx;
+}
+
+static void tcpsvr_drop_client(struct tcpsvr *svr, int idx)
+{
+    struct tcpsvr_client *cli = &svr->clients[idx];
+    if (svr->close_cb) {
+        svr->close_cb(svr, idx, svr->close_arg);
+    }
+    tcpsvr_ev_del(svr, cli->socket);
+    wsocket_close(cli->socket);
+    if (cli->prev != -1) {
+        svr->clients[cli->prev].next = cli->next;
+    } else {
+        svr->head = cli->next;
+    }
+    if (cli->next != -1) {
+        svr->clients[cli->next].prev = cli->prev;
+    } else {
+        svr->tail = cli->prev;
+    }
+    if (svr->cursor == idx) {
+        svr->cursor = cli->next;
+    }
+    cli->socket = INVALID_WSOCKET;
+    cli->ready = 0;
+    cli->evout = 0;
+    cli->closing = 0;
+    queue_clear(&cli->oq);
+    cli->prev = -1;
+    cli->next = svr->free_head;
+    svr->free_head = idx;
+    svr->nclients--;
+}
+
 int tcpsvr_open(struct tcpsvr *svr, const char *addr, int port)
+{
+    return tcpsvr_open_opts(svr, addr, port, NULL);
+}
+
+int tcpsvr_open_opts(struct tcpsvr *svr, const char *addr, int port,
+                     const struct tcpsvr_opts *opts)
 {
     if (svr->socket != INVALID_WSOCKET) {
         return -1;
     }
+    int backlog = SOMAXCONN;
+    int reuseport = 0;
+    svr->accept_budget = TCPSVR_ACCEPT_BUDGET;
+    svr->queue_max = TCPSVR_QUEUE_MAX;
+    svr->overflow = TCPSVR_OVERFLOW_DROP;
+    svr->block_timeout = TCPSVR_BLOCK_TIMEOUT;
+    if (opts) {
+        if (opts->backlog > 0) {
+            backlog = opts->backlog;
+        }
+        if (opts->accept_budget > 0) {
+            svr->accept_budget = opts->accept_budget;
+        }
+        if (opts->queue_max > 0) {
+            svr->queue_max = opts->queue_max;
+        }
+        if (opts->overflow >= TCPSVR_OVERFLOW_DROP && opts->overflow <= TCPSVR_OVERFLOW_BLOCK) {
+            svr->overflow = opts->overflow;
+        }
+        if (opts->block_timeout > 0) {
+            svr->block_timeout = opts->block_timeout;
+        }
+        reuseport = opts->reuseport;
+    }
     char portbuf[32];
     snprintf(portbuf, sizeof(portbuf), "%d", port);
-    svr->socket = listen_on(addr, portbuf);
+    svr->socket = listen_on(addr, portbuf, backlog, reuseport);
     if (svr->socket == INVALID_WSOCKET) {
         return -1;
     }
@@ -89,44 +440,46 @@ int tcpsvr_open(struct tcpsvr *svr, const char *addr, int port)
 
 int tcpsvr_count_clients(struct tcpsvr *svr)
 {
-    int cnt = 0;
-    for (int i = 0; i < TCPSVR_MAX_CLI; i++) {
-        if (svr->clients[i] != INVALID_WSOCKET) {
-            cnt++;
-        }
-    }
-    return cnt;
+    return svr->nclients;
 }
 
+// accept pending connections, at most accept_budget in one pass.
 static int tcpsvr_wait(struct tcpsvr *svr)
 {
-#ifdef SOCK_CLOEXEC
-    wsocket sock = accept4(svr->socket, NULL, NULL, SOCK_CLOEXEC);
+    for (int n = 0; n < svr->accept_budget; n++) {
+#if defined(SOCK_NONBLOCK) && defined(SOCK_CLOEXEC)
+        wsocket sock = accept4(svr->socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
 #else
-    wsocket sock = accept(svr->socket, NULL, NULL);
+        wsocket sock = accept(svr->socket, NULL, NULL);
 #endif
-    if (sock == INVALID_WSOCKET && wsocket_errno != WSOCKET_EAGAIN) {
-        return -1;
-    }
-    if (sock == INVALID_WSOCKET) {
-        return 0;
-    }
-    int idx = -1;
-    for (int i = 0; i < TCPSVR_MAX_CLI; i++) {
-        if (svr->clients[i] == INVALID_WSOCKET) {
-            idx = i;
-            break;
+        if (sock == INVALID_WSOCKET && wsocket_errno != WSOCKET_EAGAIN) {
+            return -1;
         }
+        if (sock == INVALID_WSOCKET) {
+            return 0;
+        }
+        int idx = tcpsvr_add_client(svr, sock);
+        if (idx == -1) {
+            wsocket_close(sock);
+            continue;
+        }
+#if !defined(SOCK_NONBLOCK) || !defined(SOCK_CLOEXEC)
+        wsocket_set_nonblocking(sock);
+#endif
+        tcpsvr_ev_add(svr, sock, idx);
     }
-    if (idx == -1) {
-        wsocket_close(sock);
-        return 0;
-    }
-    wsocket_set_nonblocking(sock);
-    svr->clients[idx] = sock;
     return 0;
 }
 
+static void tcpsvr_set_ready(struct tcpsvr *svr, int idx)
+{
+    struct tcpsvr_client *cli = &svr->clients[idx];
+    if (cli->socket != INVALID_WSOCKET && !cli->ready) {
+        cli->ready = 1;
+        svr->readyq[svr->nready++] = idx;
+    }
+}
+
 static int socket_recv(wsocket socket, void *buff, size_t count)
 {
     if (socket == INVALID_WSOCKET) {
@@ -142,40 +495,338 @@ static int socket_recv(wsocket socket, void *buff, size_t count)
     return rv < 0 ? 0 : rv;
 }
 
-static int socket_send(wsocket socket, const void *data, size_t count)
+static int socket_sendv(wsocket socket, const wsocket_iovec *iov, int iovcnt)
 {
     if (socket == INVALID_WSOCKET) {
         return 0;
     }
-    int rv = send(socket, data, count, 0);
+    int rv = wsocket_sendv(socket, iov, iovcnt);
     if (rv == WSOCKET_ERROR && wsocket_errno != WSOCKET_EAGAIN) {
         return -1;
     }
     return rv < 0 ? 0 : rv;
 }
 
-int tcpsvr_read(struct tcpsvr *svr, void *buff, size_t count)
+// max buffers gathered in one send
+#define SEND_IOV    64
+
+// fill iov with queued data, return buffers count.
+static int queue_iov(const struct tcpsvr_queue *q, wsocket_iovec *iov, int max)
 {
-    if (tcpsvr_wait(svr) == -1) {
+    int n = 0;
+    for (; n < q->count && n < max; n++) {
+        const struct tcpsvr_msg *msg = q->msgs[(q->head + n) & (q->cap - 1)];
+        size_t offset = n == 0 ? q->offset : 0;
+        WSOCKET_IOV_SET(&iov[n], msg->data + offset, msg->len - offset);
+    }
+    return n;
+}
+
+// remove count sent bytes from queue head.
+static void queue_consume(struct tcpsvr_queue *q, size_t count)
+{
+    while (count > 0 && q->count > 0) {
+        struct tcpsvr_msg *msg = q->msgs[q->head];
+        size_t left = msg->len - q->offset;
+        if (count < left) {
+            q->offset += count;
+            q->bytes -= count;
+            break;
+        }
+        count -= left;
+        queue_pop(q);
+    }
+}
+
+// send queued data of client, coalesced into one vectored send.
+// return 0 on success, -1 on connection error.
+static int tcpsvr_flush_client(struct tcpsvr *svr, int idx)
+{
+    struct tcpsvr_client *cli = &svr->clients[idx];
+    struct tcpsvr_queue *q = &cli->oq;
+    while (q->count > 0) {
+        wsocket_iovec iov[SEND_IOV];
+        int n = queue_iov(q, iov, SEND_IOV);
+        size_t bytes = 0;
+        for (int i = 0; i < n; i++) {
+            bytes += WSOCKET_IOV_LEN(&iov[i]);
+        }
+        int rv = socket_sendv(cli->socket, iov, n);
+        if (rv == -1) {
+            return -1;
+        }
+        queue_consume(q, rv);
+        if ((size_t)rv < bytes) {
+            break; // would block
+        }
+    }
+    if (cli->closing && q->count == 0) {
+        return -1;
+    }
+    tcpsvr_ev_update(svr, idx);
+    return 0;
+}
+
+// queue msg after offset bytes sent, offset must be 0 if queue is not empty.
+// takes the msg reference. return 0 on success, -1 if client should be closed.
+static int tcpsvr_enqueue(struct tcpsvr *svr, int idx, struct tcpsvr_msg *msg, size_t offset)
+{
+    struct tcpsvr_client *cli = &svr->clients[idx];
+    struct tcpsvr_queue *q = &cli->oq;
+    size_t need = msg->len - offset;
+    if (q->bytes + need > svr->queue_max) {
+        if (svr->overflow == TCPSVR_OVERFLOW_CLOSE) {
+            tcpsvr_msg_release(msg);
+            return -1;
+        } else if (svr->overflow == TCPSVR_OVERFLOW_BLOCK) {
+            while (q->count > 0 && q->bytes + need > svr->queue_max) {
+                int rv = wsocket_poll(cli->socket, WSOCKET_POLLOUT, svr->block_timeout);
+                if (rv <= 0 || (rv & WSOCKET_POLLERR) || tcpsvr_flush_client(svr, idx) == -1) {
+                    tcpsvr_msg_release(msg);
+                    return -1;
+                }
+            }
+        } else {
+            while (q->bytes + need > svr->queue_max && queue_drop_oldest(q) == 0) {
+            }
+            if (q->bytes + need > svr->queue_max && offset == 0) {
+                // no room even for this message, partially sent one must be kept
+                q->dropped++;
+                tcpsvr_msg_release(msg);
+                return 0;
+            }
+        }
+    }
+    if (queue_push(q, msg) == -1) {
+        tcpsvr_msg_release(msg);
+        return -1;
+    }
+    if (q->count == 1) {
+        q->offset = offset;
+        q->bytes -= offset;
+    }
+    tcpsvr_ev_update(svr, idx);
+    return 0;
+}
+
+// copy iov into a new message
+static struct tcpsvr_msg *msg_from_iov(const wsocket_iovec *iov, int iovcnt, size_t count)
+{
+    struct tcpsvr_msg *msg = tcpsvr_msg_new(NULL, count);
+    if (msg == NULL) {
+        return NULL;
+    }
+    size_t off = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(msg->data + off, WSOCKET_IOV_BASE(&iov[i]), WSOCKET_IOV_LEN(&iov[i]));
+        off += WSOCKET_IOV_LEN(&iov[i]);
+    }
+    return msg;
+}
+
+// send count bytes in iov to client, together with queued data in one
+// vectored send when possible. the remains are queued by reference of *msg,
+// which is created from iov when first needed, so slow clients share one copy.
+// return 0 on success, -1 if client should be closed.
+static int tcpsvr_send_client(struct tcpsvr *svr, int idx,
+                              const wsocket_iovec *iov, int iovcnt, size_t count,
+                              struct tcpsvr_msg **msg)
+{
+    struct tcpsvr_client *cli = &svr->clients[idx];
+    struct tcpsvr_queue *q = &cli->oq;
+    size_t sent = 0;
+    if (cli->closing) {
+        return 0;
+    }
+    if (q->count + iovcnt > SEND_IOV && tcpsvr_flush_client(svr, idx) == -1) {
+        return -1;
+    }
+    if (q->count + iovcnt <= SEND_IOV) {
+        wsocket_iovec vec[SEND_IOV];
+        int n = queue_iov(q, vec, SEND_IOV);
+        memcpy(vec + n, iov, iovcnt * sizeof(*iov));
+        size_t queued = q->bytes;
+        int rv = socket_sendv(cli->socket, vec, n + iovcnt);
+        if (rv == -1) {
+            return -1;
+        }
+        queue_consume(q, rv);
+        tcpsvr_ev_update(svr, idx);
+        if ((size_t)rv > queued) {
+            sent = rv - queued;
+        }
+    }
+    if (sent == count) {
+        return 0;
+    }
+    if (*msg == NULL && (*msg = msg_from_iov(iov, iovcnt, count)) == NULL) {
+        return -1;
+    }
+    return tcpsvr_enqueue(svr, idx, tcpsvr_msg_ref(*msg), sent);
+}
+
+// max events handled in one tcpsvr_poll, others are reported by next call
+#define POLL_EVENTS 256
+
+int tcpsvr_poll(struct tcpsvr *svr, int timeout)
+{
+    if (svr->socket == INVALID_WSOCKET) {
+        return -1;
+    }
+    if (!svr->evmode) {
+        tcpsvr_ev_start(svr);
+    }
+    svr->evmode = 1;
+    // readiness not consumed since last poll will be reported again
+    for (size_t i = svr->ready_idx; i < svr->nready; i++) {
+        svr->clients[svr->readyq[i]].ready = 0;
+    }
+    svr->nready = 0;
+    svr->ready_idx = 0;
+    int accept_pending = 0;
+#ifdef __linux__
+    if (svr->evfd != -1) {
+        struct epoll_event evs[POLL_EVENTS];
+        int n = epoll_wait(svr->evfd, evs, POLL_EVENTS, timeout);
+        if (n == -1) {
+            return errno == WSOCKET_EINTR ? 0 : -1;
+        }
+        for (int i = 0; i < n; i++) {
+            unsigned int idx = evs[i].data.u32;
+            if (idx == EV_LISTEN) {
+                accept_pending = 1;
+                continue;
+            }
+            if (idx >= (unsigned int)svr->cap || svr->clients[idx].socket == INVALID_WSOCKET) {
+                continue;
+            }
+            if ((evs[i].events & EPOLLOUT) && tcpsvr_flush_client(svr, idx) == -1) {
+                tcpsvr_drop_client(svr, idx);
+                continue;
+            }
+            if (evs[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                tcpsvr_set_ready(svr, idx);
+            }
+        }
+        if (accept_pending && tcpsvr_wait(svr) == -1) {
+            return -1;
+        }
+        return svr->nready;
+    }
+#endif
+    fd_set rfds;
+    fd_set wfds;
+    FD_ZERO(&rfds);
+    FD_ZERO(&wfds);
+    FD_SET(svr->socket, &rfds);
+    wsocket maxfd = svr->socket;
+    int nfds = 1;
+    for (int i = svr->head; i != -1 && nfds < FD_SETSIZE; i = svr->clients[i].next) {
+        wsocket sock = svr->clients[i].socket;
+#ifndef _WIN32
+        if (sock >= FD_SETSIZE) {
+            continue;
+        }
+#endif
+        FD_SET(sock, &rfds);
+        if (svr->clients[i].oq.count > 0) {
+            FD_SET(sock, &wfds);
+        }
+        nfds++;
+        if (sock > maxfd) {
+            maxfd = sock;
+        }
+    }
+    struct timeval tv = {0};
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+    int n = select(maxfd + 1, &rfds, &wfds, NULL, timeout < 0 ? NULL : &tv);
+    if (n == WSOCKET_ERROR) {
+        return wsocket_errno == WSOCKET_EINTR ? 0 : -1;
+    }
+    int next = -1;
+    for (int i = svr->head; i != -1 && n > 0; i = next) {
+        next = svr->clients[i].next;
+        wsocket sock = svr->clients[i].socket;
+#ifndef _WIN32
+        if (sock >= FD_SETSIZE) {
+            continue;
+        }
+#endif
+        if (FD_ISSET(sock, &wfds) && tcpsvr_flush_client(svr, i) == -1) {
+            tcpsvr_drop_client(svr, i);
+            continue;
+        }
+        if (FD_ISSET(sock, &rfds)) {
+            tcpsvr_set_ready(svr, i);
+        }
+    }
+    if (FD_ISSET(svr->socket, &rfds)) {
+        accept_pending = 1;
+    }
+    if (accept_pending && tcpsvr_wait(svr) == -1) {
         return -1;
     }
+    return svr->nready;
+}
+
+// read from clients reported by tcpsvr_poll
+static int tcpsvr_read_ready(struct tcpsvr *svr, void *buff, size_t count)
+{
     if (svr->read == TCPSVR_READ_EVERY) {
-        int cnt= 0;
-        wsocket *sock = NULL;
-        while (cnt < TCPSVR_MAX_CLI) {
-            if (svr->clients[svr->idx % TCPSVR_MAX_CLI] != INVALID_WSOCKET) {
-                sock = &svr->clients[svr->idx % TCPSVR_MAX_CLI];
-                svr->idx++;
-                break;
+        while (svr->ready_idx < svr->nready) {
+            int idx = svr->readyq[svr->ready_idx++];
+            if (!svr->clients[idx].ready) {
+                continue;
+            }
+            svr->clients[idx].ready = 0;
+            int rv = socket_recv(svr->clients[idx].socket, buff, count);
+            if (rv == -1) {
+                tcpsvr_drop_client(svr, idx);
             }
-            svr->idx++;
-            cnt++;
+            return rv <= 0 ? 0 : rv;
         }
-        if (sock) {
-            int rv = socket_recv(*sock, buff, count);
+        return 0;
+    }
+    // first valid client is the data source in TCPSVR_READ_ONLYONE
+    int first = svr->read == TCPSVR_READ_ONLYONE ? svr->head : -1;
+    unsigned char dummy[256];
+    int rv = 0;
+    while (svr->ready_idx < svr->nready) {
+        int idx = svr->readyq[svr->ready_idx++];
+        if (!svr->clients[idx].ready) {
+            continue;
+        }
+        svr->clients[idx].ready = 0;
+        int r = 0;
+        if (idx == first) {
+            r = rv = socket_recv(svr->clients[idx].socket, buff, count);
+        } else {
+            r = socket_recv(svr->clients[idx].socket, dummy, sizeof(dummy));
+        }
+        if (r == -1) {
+            tcpsvr_drop_client(svr, idx);
+        }
+    }
+    return rv < 0 ? 0 : rv;
+}
+
+int tcpsvr_read(struct tcpsvr *svr, void *buff, size_t count)
+{
+    if (svr->evmode) {
+        return tcpsvr_read_ready(svr, buff, count);
+    }
+    if (tcpsvr_wait(svr) == -1) {
+        return -1;
+    }
+    if (svr->read == TCPSVR_READ_EVERY) {
+        // round robin over valid clients
+        int idx = svr->cursor != -1 ? svr->cursor : svr->head;
+        if (idx != -1) {
+            svr->cursor = svr->clients[idx].next;
+            int rv = socket_recv(svr->clients[idx].socket, buff, count);
             if (rv == -1) {
-                wsocket_close(*sock);
-                *sock = INVALID_WSOCKET;
+                tcpsvr_drop_client(svr, idx);
             }
             return rv <= 0 ? 0 : rv;
         }
@@ -184,22 +835,21 @@ int tcpsvr_read(struct tcpsvr *svr, void *buff, size_t count)
         unsigned char dummy[256];
         int first = 0;
         int rv = 0;
-        for (int i = 0; i < TCPSVR_MAX_CLI; i++) {
-            wsocket *sock = &svr->clients[i];
-            if (*sock != INVALID_WSOCKET) {
-                if (svr->read == TCPSVR_READ_ONLYONE && first == 0) {
-                    rv = socket_recv(*sock, buff, count);
-                    if (rv == -1) {
-                        wsocket_close(*sock);
-                        *sock = INVALID_WSOCKET;
-                        rv = 0;
-                    }
-                } else {
-                    int r = socket_recv(*sock, dummy, sizeof(dummy));
-                    if (r == -1) {
-                        wsocket_close(*sock);
-                        *sock = INVALID_WSOCKET;
-                    }
+        int next = -1;
+        for (int i = svr->head; i != -1; i = next) {
+            next = svr->clients[i].next;
+            wsocket sock = svr->clients[i].socket;
+            if (svr->read == TCPSVR_READ_ONLYONE && first == 0) {
+                first = 1;
+                rv = socket_recv(sock, buff, count);
+                if (rv == -1) {
+                    tcpsvr_drop_client(svr, i);
+                    rv = 0;
+                }
+            } else {
+                int r = socket_recv(sock, dummy, sizeof(dummy));
+                if (r == -1) {
+                    tcpsvr_drop_client(svr, i);
                 }
             }
         }
@@ -209,18 +859,183 @@ int tcpsvr_read(struct tcpsvr *svr, void *buff, size_t count)
 
 int tcpsvr_write(struct tcpsvr *svr, const void *data, size_t count)
 {
-    if (tcpsvr_wait(svr) == -1) {
+    wsocket_iovec iov;
+    WSOCKET_IOV_SET(&iov, data, count);
+    return tcpsvr_writev(svr, &iov, 1);
+}
+
+int tcpsvr_writev(struct tcpsvr *svr, const wsocket_iovec *iov, int iovcnt)
+{
+    if (iovcnt < 0 || iovcnt > TCPSVR_MAX_IOV) {
+        return -1;
+    }
+    if (!svr->evmode && tcpsvr_wait(svr) == -1) {
         return -1;
     }
-    for (int i = 0; i < TCPSVR_MAX_CLI; i++) {
-        if (socket_send(svr->clients[i], data, count) == -1) {
-            wsocket_close(svr->clients[i]);
-            svr->clients[i] = INVALID_WSOCKET;
+    size_t count = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        count += WSOCKET_IOV_LEN(&iov[i]);
+    }
+    struct tcpsvr_msg *msg = NULL;
+    int next = -1;
+    for (int i = svr->head; i != -1; i = next) {
+        next = svr->clients[i].next;
+        if (tcpsvr_send_client(svr, i, iov, iovcnt, count, &msg) == -1) {
+            tcpsvr_drop_client(svr, i);
         }
     }
+    tcpsvr_msg_release(msg);
     return count;
 }
 
+int tcpsvr_broadcast_msg(struct tcpsvr *svr, struct tcpsvr_msg *msg)
+{
+    if (!svr->evmode && tcpsvr_wait(svr) == -1) {
+        return -1;
+    }
+    wsocket_iovec iov;
+    WSOCKET_IOV_SET(&iov, msg->data, msg->len);
+    int next = -1;
+    for (int i = svr->head; i != -1; i = next) {
+        next = svr->clients[i].next;
+        if (tcpsvr_send_client(svr, i, &iov, 1, msg->len, &msg) == -1) {
+            tcpsvr_drop_client(svr, i);
+        }
+    }
+    return msg->len;
+}
+
+int tcpsvr_flush(struct tcpsvr *svr)
+{
+    int next = -1;
+    for (int i = svr->head; i != -1; i = next) {
+        next = svr->clients[i].next;
+        if (svr->clients[i].oq.count > 0 && tcpsvr_flush_client(svr, i) == -1) {
+            tcpsvr_drop_client(svr, i);
+        }
+    }
+    return 0;
+}
+
+void tcpsvr_set_close_cb(struct tcpsvr *svr, tcpsvr_close_cb cb, void *arg)
+{
+    svr->close_cb = cb;
+    svr->close_arg = arg;
+}
+
+static int tcpsvr_valid_client(struct tcpsvr *svr, int id)
+{
+    return id >= 0 && id < svr->cap && svr->clients[id].socket != INVALID_WSOCKET;
+}
+
+int tcpsvr_read_client(struct tcpsvr *svr, int *id, void *buff, size_t count)
+{
+    int idx = -1;
+    if (svr->evmode) {
+        while (svr->ready_idx < svr->nready && idx == -1) {
+            idx = svr->readyq[svr->ready_idx++];
+            if (!svr->clients[idx].ready) {
+                idx = -1;
+            }
+        }
+        if (idx != -1) {
+            svr->clients[idx].ready = 0;
+        }
+    } else {
+        if (svr->cursor == -1) {
+            // new pass
+            if (tcpsvr_wait(svr) == -1) {
+                *id = -1;
+                return -1;
+            }
+            svr->cursor = svr->head;
+        }
+        idx = svr->cursor;
+        if (idx != -1) {
+            svr->cursor = svr->clients[idx].next;
+        }
+    }
+    *id = idx;
+    if (idx == -1) {
+        return 0;
+    }
+    int rv = socket_recv(svr->clients[idx].socket, buff, count);
+    if (rv == -1) {
+        tcpsvr_drop_client(svr, idx);
+    }
+    return rv <= 0 ? 0 : rv;
+}
+
+int tcpsvr_send(struct tcpsvr *svr, int id, const void *data, size_t count)
+{
+    if (!tcpsvr_valid_client(svr, id)) {
+        return -1;
+    }
+    wsocket_iovec iov;
+    WSOCKET_IOV_SET(&iov, data, count);
+    struct tcpsvr_msg *msg = NULL;
+    int rv = tcpsvr_send_client(svr, id, &iov, 1, count, &msg);
+    tcpsvr_msg_release(msg);
+    if (rv == -1) {
+        tcpsvr_drop_client(svr, id);
+        return -1;
+    }
+    return count;
+}
+
+int tcpsvr_send_msg(struct tcpsvr *svr, int id, struct tcpsvr_msg *msg)
+{
+    if (!tcpsvr_valid_client(svr, id)) {
+        return -1;
+    }
+    wsocket_iovec iov;
+    WSOCKET_IOV_SET(&iov, msg->data, msg->len);
+    if (tcpsvr_send_client(svr, id, &iov, 1, msg->len, &msg) == -1) {
+        tcpsvr_drop_client(svr, id);
+        return -1;
+    }
+    return msg->len;
+}
+
+int tcpsvr_close_client(struct tcpsvr *svr, int id)
+{
+    if (!tcpsvr_valid_client(svr, id)) {
+        return -1;
+    }
+    struct tcpsvr_client *cli = &svr->clients[id];
+    if (cli->oq.count == 0) {
+        tcpsvr_drop_client(svr, id);
+    } else {
+        cli->closing = 1;
+    }
+    return 0;
+}
+
+int tcpsvr_abort_client(struct tcpsvr *svr, int id)
+{
+    if (!tcpsvr_valid_client(svr, id)) {
+        return -1;
+    }
+    tcpsvr_drop_client(svr, id);
+    return 0;
+}
+
+int tcpsvr_client_stats(struct tcpsvr *svr, struct tcpsvr_cli_stat *stats, int n)
+{
+    int cnt = 0;
+    for (int i = svr->head; i != -1 && cnt < n; i = svr->clients[i].next) {
+        const struct tcpsvr_client *cli = &svr->clients[i];
+        stats[cnt].id = i;
+        stats[cnt].socket = cli->socket;
+        stats[cnt].msgs = cli->oq.count;
+        stats[cnt].queued = cli->oq.bytes;
+        stats[cnt].peak = cli->oq.peak;
+        stats[cnt].dropped = cli->oq.dropped;
+        cnt++;
+    }
+    return cnt;
+}
+
 int tcpsvr_close(struct tcpsvr *svr)
 {
     if (svr) {
@@ -228,13 +1043,32 @@ int tcpsvr_close(struct tcpsvr *svr)
             wsocket_close(svr->socket);
             svr->socket = INVALID_WSOCKET;
         }
-        for (int i = 0; i < TCPSVR_MAX_CLI; i++) {
-            if (svr->clients[i] != INVALID_WSOCKET) {
-                wsocket_close(svr->clients[i]);
-                svr->clients[i] = INVALID_WSOCKET;
+        for (int i = svr->head; i != -1; i = svr->clients[i].next) {
+            if (svr->close_cb) {
+                svr->close_cb(svr, i, svr->close_arg);
             }
+            wsocket_close(svr->clients[i].socket);
+            queue_clear(&svr->clients[i].oq);
+        }
+        free(svr->clients);
+        svr->clients = NULL;
+        free(svr->readyq);
+        svr->readyq = NULL;
+        svr->cap = 0;
+        svr->nclients = 0;
+        svr->free_head = -1;
+        svr->head = -1;
+        svr->tail = -1;
+        svr->cursor = -1;
+#ifdef __linux__
+        if (svr->evfd != -1) {
+            close(svr->evfd);
+            svr->evfd = -1;
         }
+#endif
+        svr->evmode = 0;
+        svr->nready = 0;
+        svr->ready_idx = 0;
     }
     return 0;
 }
-
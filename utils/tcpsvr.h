@@ -9,7 +9,7 @@
 extern "C" {
 #endif
 
-// max clients count
+// default max clients count
 #define TCPSVR_MAX_CLI  32
 
 enum {
@@ -19,29 +19,202 @@ enum {
     TCPSVR_READ_EVERY,   // every client data will be read
 };
 
+// max buffers count of tcpsvr_writev
+#define TCPSVR_MAX_IOV          32
+// default max connections accepted in one pass
+#define TCPSVR_ACCEPT_BUDGET    64
+// default max queued bytes of each client
+#define TCPSVR_QUEUE_MAX        (64 * 1024)
+// default wait time of TCPSVR_OVERFLOW_BLOCK, in milliseconds
+#define TCPSVR_BLOCK_TIMEOUT    1000
+
+// what to do when client output queue is full
+enum {
+    TCPSVR_OVERFLOW_DROP,   // drop oldest queued messages, or the new one if
+                            // still no room. partially sent message is kept.
+    TCPSVR_OVERFLOW_CLOSE,  // disconnect client
+    TCPSVR_OVERFLOW_BLOCK,  // wait client writable until there is room, at most
+                            // block_timeout, then disconnect client.
+};
+
+// tcpsvr open options, zero means default.
+struct tcpsvr_opts {
+    int backlog;        // listen backlog, <= 0 means SOMAXCONN.
+    int accept_budget;  // max connections accepted in one pass,
+                        // <= 0 means TCPSVR_ACCEPT_BUDGET.
+    size_t queue_max;   // max queued bytes of each client, 0 means TCPSVR_QUEUE_MAX.
+    int overflow;       // TCPSVR_OVERFLOW_XXX
+    int block_timeout;  // milliseconds, <= 0 means TCPSVR_BLOCK_TIMEOUT.
+    int reuseport;      // set SO_REUSEPORT, so several tcpsvr in threads can
+                        // listen on the same port and kernel spreads clients.
+};
+
+// reference counted immutable message, see tcpsvr_msg_new. reference count is
+// atomic, so a message can be shared by tcpsvr in different threads.
+struct tcpsvr_msg;
+
+struct tcpsvr;
+
+// called when client id is disconnected or closed, before its slot is reused.
+typedef void (*tcpsvr_close_cb)(struct tcpsvr *svr, int id, void *arg);
+
+// client output queue, holds data not accepted by socket yet.
+struct tcpsvr_queue {
+    struct tcpsvr_msg **msgs; // ring of queued messages
+    int    cap;     // ring capacity, power of 2
+    int    head;
+    int    count;
+    size_t offset;  // sent bytes of head message
+    size_t bytes;   // queued unsent bytes
+    size_t peak;    // max queued bytes
+    size_t dropped; // dropped messages count
+};
+
+// client queue stat
+struct tcpsvr_cli_stat {
+    int     id;      // client slot index
+    wsocket socket;
+    int     msgs;    // queued messages count
+    size_t  queued;  // queued unsent bytes
+    size_t  peak;    // max queued bytes
+    size_t  dropped; // dropped messages count
+};
+
+// client slot, slots are allocated in a slab and never move by index.
+struct tcpsvr_client {
+    wsocket socket; // INVALID_WSOCKET if slot is free
+    int     prev;   // previous valid client, -1 if none
+    int     next;   // next valid client, or next free slot if slot is free
+    int     ready;  // has pending events
+    int     evout;  // writable event registered
+    int     closing; // close once queued data is sent, see tcpsvr_close_client
+    struct tcpsvr_queue oq;
+};
+
 struct tcpsvr {
     wsocket socket;
-    wsocket clients[TCPSVR_MAX_CLI];
-    int     read;   // TCPSVR_READ_XXX
-    size_t  idx;
+    struct tcpsvr_client *clients; // client slab, grows on demand
+    int     cap;       // allocated slots
+    int     max_cli;   // max clients count, new connection is closed if reached
+    int     nclients;  // valid clients count
+    int     free_head; // free slots list
+    int     head;      // valid clients list, in accept order
+    int     tail;
+    int     read;      // TCPSVR_READ_XXX
+    int     cursor;    // next client to read in TCPSVR_READ_EVERY
+    int     accept_budget; // max connections accepted in one pass
+    size_t  queue_max;     // max queued bytes of each client
+    int     overflow;      // TCPSVR_OVERFLOW_XXX
+    int     block_timeout; // wait time of TCPSVR_OVERFLOW_BLOCK
+
+    int     evfd;   // epoll instance created by first tcpsvr_poll, -1 if none
+    int     evmode; // event-driven mode, enabled by first tcpsvr_poll call
+    int    *readyq; // ready clients, filled by tcpsvr_poll, cap entries
+    size_t  nready;
+    size_t  ready_idx;
+
+    tcpsvr_close_cb close_cb; // client close callback, NULL if none
+    void   *close_arg;
 };
 
 
 // init tcpsvr, always return 0.
-int tcpsvr_init(struct tcpsvr *svr, int readflag);
+// max_cli: max clients count, <= 0 means TCPSVR_MAX_CLI.
+int tcpsvr_init(struct tcpsvr *svr, int readflag, int max_cli);
 
 // open tcpsvr, return 0 on success, -1 on error.
 int tcpsvr_open(struct tcpsvr *svr, const char *addr, int port);
 
-// return valid clients count
+// same as tcpsvr_open, with options. opts can be NULL.
+int tcpsvr_open_opts(struct tcpsvr *svr, const char *addr, int port,
+                     const struct tcpsvr_opts *opts);
+
+// return valid clients count, O(1).
 int tcpsvr_count_clients(struct tcpsvr *svr);
 
+// wait for events on listen socket and clients, at most timeout milliseconds,
+// < 0 means wait forever, 0 means return immediately.
+// it accepts new connections and collects readable clients, then tcpsvr_read
+// only touches these clients. once called, tcpsvr works in event-driven mode:
+// tcpsvr_read/tcpsvr_write no longer accept connections or scan every client,
+// so call it in every loop iteration.
+// uses epoll on linux, select on others.
+// return ready clients count, -1 on error.
+int tcpsvr_poll(struct tcpsvr *svr, int timeout);
+
 // read from tcpsvr in non-blocking mode.
 int tcpsvr_read(struct tcpsvr *svr, void *buff, size_t count);
 
-// write into tcpsvr.
+// write into every client.
+// data not accepted by client socket is queued and sent when client becomes
+// writable, see tcpsvr_opts for queue limit and overflow policy.
+// return count, -1 on error.
 int tcpsvr_write(struct tcpsvr *svr, const void *data, size_t count);
 
+// create message with count bytes copied from data, data can be NULL to fill
+// it later by tcpsvr_msg_data. caller holds one reference.
+// return NULL on error.
+struct tcpsvr_msg *tcpsvr_msg_new(const void *data, size_t count);
+
+// get message payload, only modify it before the message is written.
+void *tcpsvr_msg_data(struct tcpsvr_msg *msg);
+
+// get message payload size.
+size_t tcpsvr_msg_size(const struct tcpsvr_msg *msg);
+
+// add a reference, return msg.
+struct tcpsvr_msg *tcpsvr_msg_ref(struct tcpsvr_msg *msg);
+
+// drop a reference, message is freed when the last one is dropped.
+void tcpsvr_msg_release(struct tcpsvr_msg *msg);
+
+// write message into every client, same as tcpsvr_write, but clients that
+// can not take it at once queue the message by reference instead of a copy.
+// caller still holds its reference and should release it.
+// return message size, -1 on error.
+int tcpsvr_broadcast_msg(struct tcpsvr *svr, struct tcpsvr_msg *msg);
+
+// same as tcpsvr_write, data is gathered from iovcnt buffers, at most
+// TCPSVR_MAX_IOV. each client gets queued data and new data in one vectored
+// send, data not accepted is queued as one message.
+// return total bytes, -1 on error.
+int tcpsvr_writev(struct tcpsvr *svr, const wsocket_iovec *iov, int iovcnt);
+
+// send queued data of every client, tcpsvr_poll and tcpsvr_write do this
+// automatically. return 0.
+int tcpsvr_flush(struct tcpsvr *svr);
+
+// get queue stat of at most n clients, in accept order.
+// return count of stats filled.
+int tcpsvr_client_stats(struct tcpsvr *svr, struct tcpsvr_cli_stat *stats, int n);
+
+// set client close callback, NULL to unset.
+void tcpsvr_set_close_cb(struct tcpsvr *svr, tcpsvr_close_cb cb, void *arg);
+
+// read from next client with data, regardless of read flag. every client is
+// read at most once in a pass, *id is set to -1 when pass is done, then next
+// call starts a new pass. in event-driven mode, only clients reported by
+// tcpsvr_poll are read.
+// return bytes count, 0 if no data or client disconnected. *id is client read.
+int tcpsvr_read_client(struct tcpsvr *svr, int *id, void *buff, size_t count);
+
+// write into client id, data not accepted is queued same as tcpsvr_write.
+// client is closed on error.
+// return count, -1 on error or invalid client.
+int tcpsvr_send(struct tcpsvr *svr, int id, const void *data, size_t count);
+
+// write message into client id, queued by reference as tcpsvr_broadcast_msg.
+// return message size, -1 on error or invalid client.
+int tcpsvr_send_msg(struct tcpsvr *svr, int id, struct tcpsvr_msg *msg);
+
+// close client id after its queued data is sent, data written later is
+// dropped. return 0, -1 if invalid client.
+int tcpsvr_close_client(struct tcpsvr *svr, int id);
+
+// close client id at once, queued data is discarded.
+// return 0, -1 if invalid client.
+int tcpsvr_abort_client(struct tcpsvr *svr, int id);
+
 // close tcpsvr, always return 0.
 int tcpsvr_close(struct tcpsvr *svr);
 
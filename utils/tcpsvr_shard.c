@@ -0,0 +1,214 @@
+#include "tcpsvr_shard.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+// epoll event data of wake eventfd, out of client index range so tcpsvr_poll
+// skips it
+#define EV_WAKE         ((unsigned int)-2)
+// max wait of worker poll, in milliseconds
+#define SHARD_POLL_MS   100
+
+#ifdef __linux__
+static void shard_wake(struct tcpsvr_shard *sh)
+{
+    uint64_t v = 1;
+    (void)!write(sh->wakefd, &v, sizeof(v));
+}
+
+// broadcast queued messages, at most TCPSVR_MAX_IOV of them in one vectored
+// send per client.
+static void shard_drain(struct tcpsvr_shard *sh)
+{
+    unsigned int head = sh->head;
+    unsigned int tail = __atomic_load_n(&sh->tail, __ATOMIC_SEQ_CST);
+    while (head != tail) {
+        struct tcpsvr_msg *msgs[TCPSVR_MAX_IOV];
+        wsocket_iovec iov[TCPSVR_MAX_IOV];
+        int n = 0;
+        for (; head != tail && n < TCPSVR_MAX_IOV; head++, n++) {
+            msgs[n] = sh->ring[head & sh->mask];
+            WSOCKET_IOV_SET(&iov[n], tcpsvr_msg_data(msgs[n]), tcpsvr_msg_size(msgs[n]));
+        }
+        if (n == 1) {
+            tcpsvr_broadcast_msg(&sh->svr, msgs[0]);
+        } else {
+            tcpsvr_writev(&sh->svr, iov, n);
+        }
+        for (int i = 0; i < n; i++) {
+            tcpsvr_msg_release(msgs[i]);
+        }
+        // publish consumed slots, then check for messages pushed meanwhile.
+        // pairs with the tail store and head load in producer.
+        __atomic_store_n(&sh->head, head, __ATOMIC_SEQ_CST);
+        tail = __atomic_load_n(&sh->tail, __ATOMIC_SEQ_CST);
+    }
+}
+
+static void *shard_main(void *arg)
+{
+    struct tcpsvr_shard *sh = arg;
+    char buf[256];
+    while (!__atomic_load_n(&sh->group->stop, __ATOMIC_ACQUIRE)) {
+        tcpsvr_poll(&sh->svr, SHARD_POLL_MS);
+        uint64_t v = 0;
+        (void)!read(sh->wakefd, &v, sizeof(v));
+        // clients send nothing, read to detect disconnection
+        tcpsvr_read(&sh->svr, buf, sizeof(buf));
+        shard_drain(sh);
+        __atomic_store_n(&sh->nclients, tcpsvr_count_clients(&sh->svr), __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+// push message to shard ring, return 0 on success, -1 if ring is full.
+static int shard_push(struct tcpsvr_shard *sh, struct tcpsvr_msg *msg)
+{
+    unsigned int tail = sh->tail;
+    if (tail - __atomic_load_n(&sh->head, __ATOMIC_ACQUIRE) > sh->mask) {
+        sh->dropped++;
+        return -1;
+    }
+    sh->ring[tail & sh->mask] = tcpsvr_msg_ref(msg);
+    __atomic_store_n(&sh->tail, tail + 1, __ATOMIC_SEQ_CST);
+    // wake worker only if it had drained everything, it may be in poll
+    if (__atomic_load_n(&sh->head, __ATOMIC_SEQ_CST) == tail) {
+        shard_wake(sh);
+    }
+    return 0;
+}
+
+static int shard_open(struct tcpsvr_shard *sh, const char *addr, int port,
+                      const struct tcpsvr_opts *opts)
+{
+    sh->ring = calloc(TCPSVR_SHARD_QUEUE, sizeof(*sh->ring));
+    sh->mask = TCPSVR_SHARD_QUEUE - 1;
+    sh->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (sh->ring == NULL || sh->wakefd == -1) {
+        return -1;
+    }
+    struct tcpsvr_opts o = {0};
+    if (opts) {
+        o = *opts;
+    }
+    o.reuseport = 1;
+    if (tcpsvr_open_opts(&sh->svr, addr, port, &o) == -1) {
+        return -1;
+    }
+    // first poll creates epoll instance, wake eventfd is added to it
+    if (tcpsvr_poll(&sh->svr, 0) == -1 || sh->svr.evfd == -1) {
+        return -1;
+    }
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.u32 = EV_WAKE;
+    if (epoll_ctl(sh->svr.evfd, EPOLL_CTL_ADD, sh->wakefd, &ev) == -1) {
+        return -1;
+    }
+    if (pthread_create(&sh->thread, NULL, shard_main, sh) != 0) {
+        return -1;
+    }
+    sh->started = 1;
+    return 0;
+}
+#endif
+
+int tcpsvr_shards_open(struct tcpsvr_shards *group, int n, const char *addr, int port,
+                       int max_cli, const struct tcpsvr_opts *opts)
+{
+#ifdef __linux__
+    if (n <= 0) {
+        return -1;
+    }
+    group->shards = calloc(n, sizeof(*group->shards));
+    if (group->shards == NULL) {
+        return -1;
+    }
+    group->n = n;
+    group->stop = 0;
+    // all shards are valid to close before any is opened
+    for (int i = 0; i < n; i++) {
+        struct tcpsvr_shard *sh = &group->shards[i];
+        tcpsvr_init(&sh->svr, TCPSVR_READ_NONE, max_cli);
+        sh->group = group;
+        sh->wakefd = -1;
+    }
+    for (int i = 0; i < n; i++) {
+        if (shard_open(&group->shards[i], addr, port, opts) == -1) {
+            tcpsvr_shards_close(group);
+            return -1;
+        }
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+int tcpsvr_shards_broadcast_msg(struct tcpsvr_shards *group, struct tcpsvr_msg *msg)
+{
+#ifdef __linux__
+    for (int i = 0; i < group->n; i++) {
+        shard_push(&group->shards[i], msg);
+    }
+    return tcpsvr_msg_size(msg);
+#else
+    return -1;
+#endif
+}
+
+int tcpsvr_shards_write(struct tcpsvr_shards *group, const void *data, size_t count)
+{
+    struct tcpsvr_msg *msg = tcpsvr_msg_new(data, count);
+    if (msg == NULL) {
+        return -1;
+    }
+    int rv = tcpsvr_shards_broadcast_msg(group, msg);
+    tcpsvr_msg_release(msg);
+    return rv;
+}
+
+int tcpsvr_shards_count_clients(struct tcpsvr_shards *group)
+{
+    int n = 0;
+    for (int i = 0; i < group->n; i++) {
+        n += __atomic_load_n(&group->shards[i].nclients, __ATOMIC_RELAXED);
+    }
+    return n;
+}
+
+int tcpsvr_shards_close(struct tcpsvr_shards *group)
+{
+#ifdef __linux__
+    if (group && group->shards) {
+        __atomic_store_n(&group->stop, 1, __ATOMIC_RELEASE);
+        for (int i = 0; i < group->n; i++) {
+            struct tcpsvr_shard *sh = &group->shards[i];
+            if (sh->started) {
+                shard_wake(sh);
+                pthread_join(sh->thread, NULL);
+            }
+            tcpsvr_close(&sh->svr);
+            if (sh->ring) {
+                // release messages never sent
+                for (unsigned int h = sh->head; h != sh->tail; h++) {
+                    tcpsvr_msg_release(sh->ring[h & sh->mask]);
+                }
+                free(sh->ring);
+            }
+            if (sh->wakefd != -1) {
+                close(sh->wakefd);
+            }
+        }
+        free(group->shards);
+        group->shards = NULL;
+        group->n = 0;
+    }
+#endif
+    return 0;
+}
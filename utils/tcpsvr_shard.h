@@ -0,0 +1,69 @@
+#ifndef TCPSVR_SHARD_H
+#define TCPSVR_SHARD_H
+
+#include "tcpsvr.h"
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// messages queued to each shard, power of 2
+#define TCPSVR_SHARD_QUEUE  1024
+
+struct tcpsvr_shards;
+
+// one worker thread owning a tcpsvr with its own listen socket, clients and
+// epoll instance. messages come from a single-producer single-consumer ring.
+struct tcpsvr_shard {
+    struct tcpsvr svr;
+    struct tcpsvr_shards *group;
+    pthread_t thread;
+    int     started;
+    int     wakefd;     // eventfd to wake worker from poll
+    struct tcpsvr_msg **ring;
+    unsigned int mask;
+
+    // written by producer
+    unsigned int tail;
+    size_t  dropped;    // messages dropped as ring is full
+    char    pad[64];    // keep producer and worker fields in separate cache lines
+    // written by worker
+    unsigned int head;
+    int     nclients;   // clients count of svr, readable by other threads
+};
+
+// shared-nothing multi-threaded tcpsvr (linux only). each shard listens on the
+// same port with SO_REUSEPORT, kernel spreads connections over shards.
+struct tcpsvr_shards {
+    struct tcpsvr_shard *shards;
+    int     n;
+    int     stop;
+};
+
+// open n shards listening on addr:port, each accepts at most max_cli clients,
+// opts are applied to every shard and can be NULL.
+// return 0 on success, -1 on error.
+int tcpsvr_shards_open(struct tcpsvr_shards *group, int n, const char *addr, int port,
+                       int max_cli, const struct tcpsvr_opts *opts);
+
+// write data to every client of every shard, data is copied once and shared.
+// call it from one thread only.
+// return count, -1 on error.
+int tcpsvr_shards_write(struct tcpsvr_shards *group, const void *data, size_t count);
+
+// same as tcpsvr_shards_write, message is shared by reference, caller still
+// holds its reference.
+// return message size, -1 on error.
+int tcpsvr_shards_broadcast_msg(struct tcpsvr_shards *group, struct tcpsvr_msg *msg);
+
+// return clients count of all shards, may lag behind by one poll.
+int tcpsvr_shards_count_clients(struct tcpsvr_shards *group);
+
+// stop workers and close shards, always return 0.
+int tcpsvr_shards_close(struct tcpsvr_shards *group);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // TCPSVR_SHARD_H
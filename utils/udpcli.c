@@ -1,46 +1,94 @@
 #include "udpcli.h"
+#include "resolver.h"
 #include <stdio.h>
-#include <time.h>
+#include <string.h>
+#include "wtime.h"
+#include <stdint.h>
 
-static double local_timestamp(const struct timespec *ts)
-{
-    double stamp = ts->tv_sec;
-    stamp += ts->tv_nsec * 1E-9;
-    return stamp;
-}
+#ifdef __linux__
+#include <netinet/udp.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#endif
 
-static double local_monotonic_clock()
-{
-    struct timespec ts = { 0 };
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return local_timestamp(&ts);
-}
+// max payload of one UDP GSO send
+#define GSO_MAX_BYTES   65000
+
+// resolver has no notification, with timer wheel it is checked at this
+// interval, in nanoseconds
+#define CHECK_INTERVAL  (50 * WTIME_NS_PER_MS)
 
 enum UdpcliState {
     STAT_ERROR,     // error
     STAT_WAIT,      // waiting
     STAT_CONNECTED, // connected
+    STAT_RESOLVING, // resolving address
 };
 
-static wsocket connect_to(const char *addr, const char *service)
+// current time, wheel time if attached to timer wheel
+static int64_t udpcli_now(struct udpcli *udp)
 {
-    wsocket sock = INVALID_WSOCKET;
+    return udp->wheel ? (int64_t)udp->wheel->time * WTIME_NS_PER_MS : wtime_now();
+}
 
-    struct addrinfo hints = {0};
-    hints.ai_family = PF_UNSPEC;
-    hints.ai_socktype = SOCK_DGRAM;
-    hints.ai_protocol = IPPROTO_UDP;
+// get next deadline of current state. < 0 means none.
+static int64_t udpcli_deadline(struct udpcli *udp, int64_t now)
+{
+    int64_t t = -1;
+    switch (udp->state) {
+    case STAT_ERROR:
+        // run state machine soon to close socket
+        if (udp->socket != INVALID_WSOCKET) {
+            t = now;
+        }
+        break;
+    case STAT_WAIT:
+        if (udp->reconnect_wait >= 0) {
+            t = udp->activity + WTIME_FROM_SEC(udp->reconnect_wait);
+        }
+        break;
+    case STAT_RESOLVING:
+        t = now + CHECK_INTERVAL;
+        break;
+    case STAT_CONNECTED:
+        if (udp->inactive_timeout > 0) {
+            t = udp->activity + WTIME_FROM_SEC(udp->inactive_timeout);
+        }
+        break;
+    }
+    return t;
+}
 
-    int rv = 0;
-    struct addrinfo *ai = NULL;
-    if ((rv = getaddrinfo(addr, service, &hints, &ai)) != 0) {
-        return INVALID_WSOCKET;
+// arm timer to deadline of current state. an earlier pending timer is kept,
+// it arms again when expired, so activity updates cost nothing.
+static void udpcli_arm(struct udpcli *udp)
+{
+    if (udp->wheel == NULL) {
+        return;
+    }
+    int64_t t = udpcli_deadline(udp, udpcli_now(udp));
+    if (t < 0) {
+        wtimer_del(udp->wheel, &udp->timer);
+        return;
     }
-    for (const struct addrinfo *p = ai; p != NULL; p = p->ai_next) {
+    // round up, so state machine sees deadline passed
+    uint64_t expire = t / WTIME_NS_PER_MS + 1;
+    if (!wtimer_pending(&udp->timer) || expire < udp->timer.expire) {
+        wtimer_add(udp->wheel, &udp->timer, expire);
+    }
+}
+
+static wsocket connect_to(const struct resolver_addr *addrs, int naddr)
+{
+    wsocket sock = INVALID_WSOCKET;
+
+    for (int i = 0; i < naddr; i++) {
+        const struct resolver_addr *p = &addrs[i];
 #ifdef SOCK_CLOEXEC
-        sock = socket(p->ai_family, p->ai_socktype | SOCK_CLOEXEC, p->ai_protocol);
+        sock = socket(p->family, p->socktype | SOCK_CLOEXEC, p->protocol);
 #else
-        sock = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        sock = socket(p->family, p->socktype, p->protocol);
 #endif
         if (sock == INVALID_WSOCKET) {
             continue;
@@ -49,7 +97,7 @@ static wsocket connect_to(const char *addr, const char *service)
             wsocket_close(sock);
             return INVALID_WSOCKET;
         }
-        if (connect(sock, p->ai_addr, p->ai_addrlen) == WSOCKET_ERROR) {
+        if (connect(sock, (const struct sockaddr *)&p->addr, p->addrlen) == WSOCKET_ERROR) {
             // connect error
             wsocket_close(sock);
             sock = INVALID_WSOCKET;
@@ -58,9 +106,6 @@ static wsocket connect_to(const char *addr, const char *service)
         // Got it!
         break;
     }
-
-    freeaddrinfo(ai);
-    ai = NULL;
     return sock;
 }
 
@@ -68,11 +113,14 @@ int udpcli_init(struct udpcli *udp, float inact_timeout, float reconn_wait)
 {
     udp->socket = INVALID_WSOCKET;
     udp->state = STAT_ERROR;
-    udp->activity = 0.0;
+    udp->activity = 0;
     udp->addr[0] = '\0';
     udp->serv[0] = '\0';
     udp->inactive_timeout = inact_timeout;
     udp->reconnect_wait = reconn_wait;
+    udp->gso = 1;
+    udp->wheel = NULL;
+    wtimer_init(&udp->timer, NULL, NULL);
     return 0;
 }
 
@@ -84,38 +132,53 @@ int udpcli_open(struct udpcli *udp, const char *addr, int port)
     char serv[32];
     serv[0] = '\0';
     snprintf(serv, sizeof(serv), "%d", port);
-    wsocket sock = connect_to(addr, serv);
+    struct resolver_addr addrs[RESOLVER_MAX_ADDR];
+    int naddr = resolver_resolve(addr, serv, SOCK_DGRAM, addrs, RESOLVER_MAX_ADDR);
+    if (naddr <= 0) {
+        return -1;
+    }
+    wsocket sock = connect_to(addrs, naddr);
     if (sock == INVALID_WSOCKET) {
         return -1;
     }
     udp->socket = sock;
     udp->state = STAT_CONNECTED;
-    udp->activity = local_monotonic_clock();
+    udp->activity = udpcli_now(udp);
     snprintf(udp->addr, sizeof(udp->addr), "%s", addr);
     snprintf(udp->serv, sizeof(udp->serv), "%s", serv);
+    udpcli_arm(udp);
     return 0;
 }
 
 
-static int udpcli_wait(struct udpcli *udp)
+// run state machine at now
+static int udpcli_step(struct udpcli *udp, int64_t now)
 {
-    if (udp->socket == INVALID_WSOCKET && udp->state != STAT_WAIT) {
-        return -1;
-    }
-    double now = local_monotonic_clock();
     if (udp->state == STAT_WAIT) { // check if wait timeout
-        if (udp->reconnect_wait == 0 || (udp->reconnect_wait > 0 && udp->reconnect_wait <= (now - udp->activity))) {
-            wsocket sock = connect_to(udp->addr, udp->serv);
+        if (udp->reconnect_wait == 0 || (udp->reconnect_wait > 0 && WTIME_FROM_SEC(udp->reconnect_wait) <= (now - udp->activity))) {
+            udp->state = STAT_RESOLVING;
+            udp->activity = now;
+        }
+    }
+    if (udp->state == STAT_RESOLVING) { // resolve without blocking, then connect
+        struct resolver_addr addrs[RESOLVER_MAX_ADDR];
+        int naddr = resolver_lookup(udp->addr, udp->serv, SOCK_DGRAM, addrs, RESOLVER_MAX_ADDR);
+        if (naddr > 0) {
+            wsocket sock = connect_to(addrs, naddr);
             if (sock == INVALID_WSOCKET) { // connect failed
+                udp->state = STAT_WAIT;
                 return -1;
             }
             udp->socket = sock;
             udp->state = STAT_CONNECTED;
             udp->activity = now;
+        } else if (naddr < 0) { // resolve failed
+            udp->state = STAT_WAIT;
+            return -1;
         }
     } else if (udp->state == STAT_CONNECTED) {
         // check if inactive
-        if (udp->inactive_timeout > 0 && (now - udp->activity >= udp->inactive_timeout)) { // timeout and reconnect
+        if (udp->inactive_timeout > 0 && (now - udp->activity >= WTIME_FROM_SEC(udp->inactive_timeout))) { // timeout and reconnect
             udp->state = STAT_ERROR;
         }
     }
@@ -134,6 +197,42 @@ static int udpcli_wait(struct udpcli *udp)
     return 0;
 }
 
+static int udpcli_wait(struct udpcli *udp)
+{
+    if (udp->socket == INVALID_WSOCKET && udp->state != STAT_WAIT && udp->state != STAT_RESOLVING) {
+        return -1;
+    }
+    int rv = udpcli_step(udp, udpcli_now(udp));
+    udpcli_arm(udp);
+    return rv;
+}
+
+// default timer callback
+static void udpcli_on_timer(struct wtimer *timer, void *arg)
+{
+    (void)timer;
+    udpcli_wait(arg);
+}
+
+int udpcli_update(struct udpcli *udp)
+{
+    return udpcli_wait(udp);
+}
+
+void udpcli_set_timer(struct udpcli *udp, struct wtimer_wheel *wheel, wtimer_cb cb, void *arg)
+{
+    if (udp->wheel) {
+        wtimer_del(udp->wheel, &udp->timer);
+    }
+    udp->wheel = wheel;
+    if (cb) {
+        wtimer_init(&udp->timer, cb, arg);
+    } else {
+        wtimer_init(&udp->timer, udpcli_on_timer, udp);
+    }
+    udpcli_arm(udp);
+}
+
 int udpcli_read(struct udpcli *udp, void *buff, size_t count)
 {
     if (udpcli_wait(udp) != 0) {
@@ -143,15 +242,68 @@ int udpcli_read(struct udpcli *udp, void *buff, size_t count)
         int rv = recv(udp->socket, buff, count, 0);
         if ((rv == -1 && wsocket_errno != WSOCKET_EWOULDBLOCK) || rv == 0) {
             udp->state = STAT_ERROR;
+            udpcli_arm(udp);
         }
         if (rv > 0) {
-            udp->activity = local_monotonic_clock();
+            udp->activity = udpcli_now(udp);
             return rv;
         }
     }
     return 0;
 }
 
+int udpcli_read_batch(struct udpcli *udp, struct udp_msgvec *msgs, int n)
+{
+    if (udpcli_wait(udp) != 0) {
+        return -1;
+    }
+    if (udp->state != STAT_CONNECTED || n <= 0) {
+        return 0;
+    }
+    if (n > UDPCLI_MAX_BATCH) {
+        n = UDPCLI_MAX_BATCH;
+    }
+    int cnt = 0;
+#ifdef __linux__
+    struct mmsghdr mmsgs[UDPCLI_MAX_BATCH];
+    struct iovec iovs[UDPCLI_MAX_BATCH];
+    memset(mmsgs, 0, n * sizeof(mmsgs[0]));
+    for (int i = 0; i < n; i++) {
+        iovs[i].iov_base = msgs[i].buff;
+        iovs[i].iov_len = msgs[i].size;
+        mmsgs[i].msg_hdr.msg_iov = &iovs[i];
+        mmsgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    cnt = recvmmsg(udp->socket, mmsgs, n, 0, NULL);
+    if (cnt == -1) {
+        if (wsocket_errno != WSOCKET_EWOULDBLOCK) {
+            udp->state = STAT_ERROR;
+            udpcli_arm(udp);
+        }
+        return 0;
+    }
+    for (int i = 0; i < cnt; i++) {
+        msgs[i].len = mmsgs[i].msg_len;
+    }
+#else
+    for (; cnt < n; cnt++) {
+        int rv = recv(udp->socket, msgs[cnt].buff, msgs[cnt].size, 0);
+        if (rv == -1) {
+            if (wsocket_errno != WSOCKET_EWOULDBLOCK) {
+                udp->state = STAT_ERROR;
+                udpcli_arm(udp);
+            }
+            break;
+        }
+        msgs[cnt].len = rv;
+    }
+#endif
+    if (cnt > 0) {
+        udp->activity = udpcli_now(udp);
+    }
+    return cnt;
+}
+
 int udpcli_write(struct udpcli *udp, const void *data, size_t count)
 {
     if (udpcli_wait(udp) != 0) {
@@ -161,6 +313,7 @@ int udpcli_write(struct udpcli *udp, const void *data, size_t count)
         int sd = send(udp->socket, data, count, 0);
         if ((sd == -1 && wsocket_errno != WSOCKET_EWOULDBLOCK) || sd == 0) {
             udp->state = STAT_ERROR;
+            udpcli_arm(udp);
         }
         if (sd > 0) {
             return sd;
@@ -169,10 +322,108 @@ int udpcli_write(struct udpcli *udp, const void *data, size_t count)
     return 0;
 }
 
+#ifdef __linux__
+// send datagrams of same size in one UDP GSO send.
+// return datagrams count, 0 if would block, -1 if GSO not usable.
+static int udpcli_write_gso(struct udpcli *udp, const struct udp_msgvec *msgs, int n)
+{
+    size_t seg = msgs[0].len;
+    size_t total = 0;
+    for (int i = 0; i < n; i++) {
+        if ((i < n - 1 && msgs[i].len != seg) || msgs[i].len > seg || msgs[i].len == 0) {
+            return -1;
+        }
+        total += msgs[i].len;
+    }
+    if (total > GSO_MAX_BYTES) {
+        return -1;
+    }
+    struct iovec iovs[UDPCLI_MAX_BATCH];
+    for (int i = 0; i < n; i++) {
+        iovs[i].iov_base = msgs[i].buff;
+        iovs[i].iov_len = msgs[i].len;
+    }
+    char control[CMSG_SPACE(sizeof(uint16_t))] = {0};
+    struct msghdr mh = {0};
+    mh.msg_iov = iovs;
+    mh.msg_iovlen = n;
+    mh.msg_control = control;
+    mh.msg_controllen = sizeof(control);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+    cm->cmsg_level = SOL_UDP;
+    cm->cmsg_type = UDP_SEGMENT;
+    cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    uint16_t gso_size = seg;
+    memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+    if (sendmsg(udp->socket, &mh, 0) == -1) {
+        if (wsocket_errno == WSOCKET_EWOULDBLOCK) {
+            return 0;
+        }
+        if (wsocket_errno == EINVAL || wsocket_errno == EIO ||
+            wsocket_errno == ENOPROTOOPT || wsocket_errno == EOPNOTSUPP) {
+            udp->gso = 0; // not supported, use sendmmsg from now on
+        }
+        return -1;
+    }
+    return n;
+}
+#endif
+
+int udpcli_write_batch(struct udpcli *udp, const struct udp_msgvec *msgs, int n)
+{
+    if (udpcli_wait(udp) != 0) {
+        return -1;
+    }
+    if (udp->state != STAT_CONNECTED || n <= 0) {
+        return 0;
+    }
+    if (n > UDPCLI_MAX_BATCH) {
+        n = UDPCLI_MAX_BATCH;
+    }
+    int cnt = 0;
+#ifdef __linux__
+    if (udp->gso && n > 1) {
+        cnt = udpcli_write_gso(udp, msgs, n);
+        if (cnt >= 0) {
+            return cnt;
+        }
+    }
+    struct mmsghdr mmsgs[UDPCLI_MAX_BATCH];
+    struct iovec iovs[UDPCLI_MAX_BATCH];
+    memset(mmsgs, 0, n * sizeof(mmsgs[0]));
+    for (int i = 0; i < n; i++) {
+        iovs[i].iov_base = msgs[i].buff;
+        iovs[i].iov_len = msgs[i].len;
+        mmsgs[i].msg_hdr.msg_iov = &iovs[i];
+        mmsgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    cnt = sendmmsg(udp->socket, mmsgs, n, 0);
+    if (cnt == -1) {
+        if (wsocket_errno != WSOCKET_EWOULDBLOCK) {
+            udp->state = STAT_ERROR;
+            udpcli_arm(udp);
+        }
+        return 0;
+    }
+#else
+    for (; cnt < n; cnt++) {
+        int sd = send(udp->socket, msgs[cnt].buff, msgs[cnt].len, 0);
+        if (sd == -1) {
+            if (wsocket_errno != WSOCKET_EWOULDBLOCK) {
+                udp->state = STAT_ERROR;
+                udpcli_arm(udp);
+            }
+            break;
+        }
+    }
+#endif
+    return cnt;
+}
+
 double udpcli_last_activity(struct udpcli *udp)
 {
     if (udp) {
-        return local_monotonic_clock() - udp->activity;
+        return WTIME_TO_SEC(udpcli_now(udp) - udp->activity);
     } else {
         return -1;
     }
@@ -180,13 +431,17 @@ double udpcli_last_activity(struct udpcli *udp)
 
 int udpcli_close(struct udpcli *udp)
 {
+    if (udp->wheel) {
+        wtimer_del(udp->wheel, &udp->timer);
+    }
+    // also stop waiting or resolving, not only a connected socket
     if (udp->socket != INVALID_WSOCKET) {
         wsocket_close(udp->socket);
         udp->socket = INVALID_WSOCKET;
-        udp->state = STAT_ERROR;
-        udp->activity = 0;
-        udp->addr[0] = '\0';
-        udp->serv[0] = '\0';
     }
+    udp->state = STAT_ERROR;
+    udp->activity = 0;
+    udp->addr[0] = '\0';
+    udp->serv[0] = '\0';
     return 0;
 }
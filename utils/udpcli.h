@@ -2,6 +2,7 @@
 #define UDPCLI_H
 
 #include "../wsocket.h"
+#include "wtimer.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -14,7 +15,7 @@ struct udpcli {
     wsocket socket;
 
     int state;
-    double activity;
+    int64_t activity;       // time of last activity, in nanoseconds, see wtime.h
 
     char addr[64];
     char serv[32];
@@ -22,6 +23,21 @@ struct udpcli {
     float inactive_timeout; // recv inactive timeout, in seconds. <= 0 means forever.
     float reconnect_wait;   // wait time before start reconnect. 0 means no wait.
                             // < 0 means wait forever, this makes udpcli one shot connection.
+    int   gso;              // use UDP GSO in udpcli_write_batch, 1 by default.
+                            // reset to 0 if not supported by system.
+
+    struct wtimer_wheel *wheel; // timer wheel, NULL means take time from wtime_now
+    struct wtimer timer;        // next deadline of current state
+};
+
+// max datagrams count of one batch call
+#define UDPCLI_MAX_BATCH    64
+
+// datagram buffer for batch read/write
+struct udp_msgvec {
+    void  *buff;    // datagram buffer
+    size_t size;    // buffer size
+    size_t len;     // datagram length
 };
 
 // init udpcli object
@@ -32,6 +48,18 @@ int udpcli_init(struct udpcli *tcp, float inact_timeout, float reconn_wait);
 // return 0 in success, -1 in error, it will not auto reconnect when return error.
 int udpcli_open(struct udpcli *tcp, const char *addr, int port);
 
+// run connection state machine without reading or writing: reconnect and
+// inactive timeout. udpcli_read/udpcli_write do this too.
+// return -1 in error, same as udpcli_read, otherwise 0.
+int udpcli_update(struct udpcli *udp);
+
+// attach udp to timer wheel, NULL to detach. inactive and reconnect deadlines
+// are kept as one timer in wheel, and udp takes wheel time as current time
+// instead of reading clock, so wheel should run on wtimer_clock_ms. when timer
+// expires cb is called with arg, it should call udpcli_update. NULL cb means
+// call udpcli_update directly.
+void udpcli_set_timer(struct udpcli *udp, struct wtimer_wheel *wheel, wtimer_cb cb, void *arg);
+
 // read data from udpcli object, in non-blocking mode.
 // return -1 in error, otherwise return bytes count has read.
 // it will auto reconnect in connection error or inactive detect, and not return -1
@@ -39,6 +67,13 @@ int udpcli_open(struct udpcli *tcp, const char *addr, int port);
 // connection error or in wating
 int udpcli_read(struct udpcli *tcp, void *buff, size_t count);
 
+// read at most n datagrams in one call, n is limited to UDPCLI_MAX_BATCH.
+// each msgs[i].buff of msgs[i].size bytes is filled with one datagram and its
+// length is set to msgs[i].len. uses recvmmsg on linux.
+// return -1 in error, otherwise return datagrams count has read.
+// reconnect behavior is same as udpcli_read.
+int udpcli_read_batch(struct udpcli *udp, struct udp_msgvec *msgs, int n);
+
 // write data to udpcli object, in non-blocking mode
 // return -1 in error, otherwise return bytes count has written
 // it will auto reconnect in connection error or inactive detect, and not return -1
@@ -46,6 +81,14 @@ int udpcli_read(struct udpcli *tcp, void *buff, size_t count);
 // connection error or in wating
 int udpcli_write(struct udpcli *tcp, const void *data, size_t count);
 
+// write n datagrams in one call, n is limited to UDPCLI_MAX_BATCH.
+// each msgs[i].buff of msgs[i].len bytes is sent as one datagram.
+// uses sendmmsg on linux, or one UDP GSO send if gso is set and all datagrams
+// have the same length (the last one can be shorter).
+// return -1 in error, otherwise return datagrams count has written.
+// reconnect behavior is same as udpcli_write.
+int udpcli_write_batch(struct udpcli *udp, const struct udp_msgvec *msgs, int n);
+
 // get elpased seconds since last activity, < 0 means error.
 // activity means state change or has read some data.
 double udpcli_last_activity(struct udpcli *tcp);
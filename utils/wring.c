@@ -0,0 +1,137 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include "wring.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+// map size bytes of one memfd twice in a row, return NULL on error.
+static char *map_mirrored(size_t size)
+{
+    int fd = memfd_create("wring", MFD_CLOEXEC);
+    if (fd == -1) {
+        return NULL;
+    }
+    char *addr = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+        // reserve address space, then map file over both halves
+        addr = mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (addr != MAP_FAILED) {
+        if (mmap(addr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+            mmap(addr + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            munmap(addr, 2 * size);
+            addr = MAP_FAILED;
+        }
+    }
+    close(fd);
+    return addr == MAP_FAILED ? NULL : addr;
+}
+#endif
+
+int wring_init(struct wring *ring, size_t size)
+{
+    ring->buf = NULL;
+    ring->size = 0;
+    ring->head = 0;
+    ring->len = 0;
+    ring->mirrored = 0;
+    if (size == 0) {
+        return -1;
+    }
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t mapsize = (size + page - 1) / page * page;
+    ring->buf = map_mirrored(mapsize);
+    if (ring->buf) {
+        ring->size = mapsize;
+        ring->mirrored = 1;
+        return 0;
+    }
+#endif
+    ring->buf = malloc(size);
+    if (ring->buf == NULL) {
+        return -1;
+    }
+    ring->size = size;
+    return 0;
+}
+
+void *wring_write_ptr(struct wring *ring, size_t *avail)
+{
+    if (ring->len == ring->size) {
+        *avail = 0;
+        return NULL;
+    }
+    if (ring->mirrored) {
+        size_t tail = ring->head + ring->len;
+        if (tail >= ring->size) {
+            tail -= ring->size;
+        }
+        *avail = ring->size - ring->len;
+        return ring->buf + tail;
+    }
+    size_t end = ring->size - ring->head - ring->len;
+    if (ring->head > 0 && (end == 0 || end < (ring->size - ring->len) / 2)) {
+        // most free space is in front, move data there
+        memmove(ring->buf, ring->buf + ring->head, ring->len);
+        ring->head = 0;
+    }
+    *avail = ring->size - ring->head - ring->len;
+    return ring->buf + ring->head + ring->len;
+}
+
+void wring_commit(struct wring *ring, size_t n)
+{
+    ring->len += n;
+}
+
+const void *wring_peek(struct wring *ring, size_t *len)
+{
+    *len = ring->len;
+    return ring->buf + ring->head;
+}
+
+void wring_consume(struct wring *ring, size_t n)
+{
+    if (n >= ring->len) {
+        wring_clear(ring);
+        return;
+    }
+    ring->head += n;
+    ring->len -= n;
+    if (ring->mirrored && ring->head >= ring->size) {
+        ring->head -= ring->size;
+    }
+}
+
+void wring_clear(struct wring *ring)
+{
+    ring->head = 0;
+    ring->len = 0;
+}
+
+void wring_free(struct wring *ring)
+{
+    if (ring->buf) {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+        if (ring->mirrored) {
+            munmap(ring->buf, 2 * ring->size);
+        } else {
+            free(ring->buf);
+        }
+#else
+        free(ring->buf);
+#endif
+    }
+    ring->buf = NULL;
+    ring->size = 0;
+    wring_clear(ring);
+    ring->mirrored = 0;
+}
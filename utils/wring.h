@@ -0,0 +1,49 @@
+#ifndef WRING_H
+#define WRING_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// byte ring buffer whose data and free space are always contiguous.
+// on linux the buffer is mapped twice back to back (memfd), so wrapped data
+// reads as one block without copy. otherwise it is a linear buffer, data is
+// moved to the front when free space at the end runs out.
+struct wring {
+    char  *buf;
+    size_t size;    // capacity
+    size_t head;    // offset of first byte
+    size_t len;     // stored bytes
+    int    mirrored;
+};
+
+// init ring of at least size bytes, mirrored if possible.
+// return 0 on success, -1 on error.
+int wring_init(struct wring *ring, size_t size);
+
+// get contiguous free space, its size is set to avail.
+// return NULL if ring is full.
+void *wring_write_ptr(struct wring *ring, size_t *avail);
+
+// mark n bytes written at write pointer as data.
+void wring_commit(struct wring *ring, size_t n);
+
+// get contiguous data of all stored bytes, its size is set to len.
+// pointer is valid until next write or consume.
+const void *wring_peek(struct wring *ring, size_t *len);
+
+// drop n bytes of data from front.
+void wring_consume(struct wring *ring, size_t n);
+
+// drop all data.
+void wring_clear(struct wring *ring);
+
+// free ring.
+void wring_free(struct wring *ring);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // WRING_H
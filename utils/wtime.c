@@ -0,0 +1,47 @@
+#include "wtime.h"
+#include <time.h>
+
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+static int m_coarse = 0;
+static THREAD_LOCAL int m_cached = 0;
+static THREAD_LOCAL int64_t m_loop_time = 0;
+
+int64_t wtime_clock(void)
+{
+    struct timespec ts = { 0 };
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(m_coarse ? CLOCK_MONOTONIC_COARSE : CLOCK_MONOTONIC, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (int64_t)ts.tv_sec * WTIME_NS_PER_SEC + ts.tv_nsec;
+}
+
+int64_t wtime_now(void)
+{
+    return m_cached ? m_loop_time : wtime_clock();
+}
+
+int64_t wtime_update(void)
+{
+    m_loop_time = wtime_clock();
+    return m_loop_time;
+}
+
+void wtime_set_cached(int on)
+{
+    if (on) {
+        wtime_update();
+    }
+    m_cached = on ? 1 : 0;
+}
+
+void wtime_set_coarse(int on)
+{
+    m_coarse = on ? 1 : 0;
+}
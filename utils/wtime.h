@@ -0,0 +1,44 @@
+#ifndef WTIME_H
+#define WTIME_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// monotonic time source of utils, in nanoseconds.
+// by default wtime_now reads clock in every call. in cached mode, the loop of
+// calling thread refreshes loop time by wtime_update once per iteration and
+// wtime_now returns it, so clients do not read clock for each read or write.
+
+#define WTIME_NS_PER_SEC    1000000000LL
+#define WTIME_NS_PER_MS     1000000LL
+
+// convert seconds to nanoseconds
+#define WTIME_FROM_SEC(s)   ((int64_t)((s) * 1E9))
+// convert nanoseconds to seconds
+#define WTIME_TO_SEC(ns)    ((ns) * 1E-9)
+
+// read clock without cache, return nanoseconds.
+int64_t wtime_clock(void);
+
+// get current time, loop time in cached mode, otherwise same as wtime_clock.
+int64_t wtime_now(void);
+
+// refresh loop time of calling thread, return it.
+int64_t wtime_update(void);
+
+// enable (1) or disable (0) cached mode of calling thread.
+// enabling also refreshes loop time.
+void wtime_set_cached(int on);
+
+// read coarse clock (CLOCK_MONOTONIC_COARSE on linux) if on is 1, it is
+// cheaper but only has a resolution of some milliseconds. affects all threads,
+// set it before starting clients.
+void wtime_set_coarse(int on);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // WTIME_H
@@ -0,0 +1,215 @@
+#include "wtimer.h"
+#include "wtime.h"
+#include <limits.h>
+#include <stddef.h>
+
+#define SLOT_MASK   (WTIMER_SLOTS - 1)
+// max distance a timer can be placed in wheel
+#define WHEEL_SPAN  (1ULL << (WTIMER_LEVELS * WTIMER_BITS))
+
+uint64_t wtimer_clock_ms(void)
+{
+    return wtime_clock() / WTIME_NS_PER_MS;
+}
+
+static void list_init(struct wtimer_link *head)
+{
+    head->next = head;
+    head->prev = head;
+}
+
+static int list_empty(const struct wtimer_link *head)
+{
+    return head->next == head;
+}
+
+static void list_add_tail(struct wtimer_link *head, struct wtimer_link *node)
+{
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+static void list_del(struct wtimer_link *node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->next = NULL;
+    node->prev = NULL;
+}
+
+// move all nodes of src into empty dst
+static void list_move(struct wtimer_link *src, struct wtimer_link *dst)
+{
+    if (list_empty(src)) {
+        list_init(dst);
+        return;
+    }
+    *dst = *src;
+    dst->next->prev = dst;
+    dst->prev->next = dst;
+    list_init(src);
+}
+
+void wtimer_wheel_init(struct wtimer_wheel *wheel, uint64_t now)
+{
+    wheel->now = now;
+    wheel->time = now;
+    wheel->count = 0;
+    for (int i = 0; i < WTIMER_LEVELS; i++) {
+        for (int j = 0; j < WTIMER_SLOTS; j++) {
+            list_init(&wheel->slots[i][j]);
+        }
+    }
+}
+
+void wtimer_init(struct wtimer *timer, wtimer_cb cb, void *arg)
+{
+    timer->link.next = NULL;
+    timer->link.prev = NULL;
+    timer->expire = 0;
+    timer->cb = cb;
+    timer->arg = arg;
+}
+
+int wtimer_pending(const struct wtimer *timer)
+{
+    return timer->link.next != NULL;
+}
+
+// put timer into slot by its distance from wheel now
+static void wheel_link(struct wtimer_wheel *wheel, struct wtimer *timer)
+{
+    uint64_t expire = timer->expire < wheel->now ? wheel->now : timer->expire;
+    uint64_t delta = expire - wheel->now;
+    if (delta >= WHEEL_SPAN) {
+        // park in top level, it is placed again when moved down
+        expire = wheel->now + WHEEL_SPAN - 1;
+        delta = WHEEL_SPAN - 1;
+    }
+    int level = 0;
+    while (level < WTIMER_LEVELS - 1 && delta >= (1ULL << ((level + 1) * WTIMER_BITS))) {
+        level++;
+    }
+    int slot = (expire >> (level * WTIMER_BITS)) & SLOT_MASK;
+    list_add_tail(&wheel->slots[level][slot], &timer->link);
+}
+
+void wtimer_add(struct wtimer_wheel *wheel, struct wtimer *timer, uint64_t expire)
+{
+    if (wtimer_pending(timer)) {
+        list_del(&timer->link);
+    } else {
+        wheel->count++;
+    }
+    timer->expire = expire;
+    wheel_link(wheel, timer);
+}
+
+void wtimer_del(struct wtimer_wheel *wheel, struct wtimer *timer)
+{
+    if (wtimer_pending(timer)) {
+        list_del(&timer->link);
+        wheel->count--;
+    }
+}
+
+// move timers of current slot in level down the wheel, return slot index.
+static int cascade(struct wtimer_wheel *wheel, int level)
+{
+    int idx = (wheel->now >> (level * WTIMER_BITS)) & SLOT_MASK;
+    struct wtimer_link list;
+    list_move(&wheel->slots[level][idx], &list);
+    while (!list_empty(&list)) {
+        struct wtimer_link *node = list.next;
+        list_del(node);
+        wheel_link(wheel, (struct wtimer *)node);
+    }
+    return idx;
+}
+
+// get earliest tick when some timer expires or has to be moved down.
+static uint64_t next_tick(const struct wtimer_wheel *wheel)
+{
+    uint64_t best = UINT64_MAX;
+    int idx = wheel->now & SLOT_MASK;
+    for (int k = 0; k < WTIMER_SLOTS; k++) {
+        if (!list_empty(&wheel->slots[0][(idx + k) & SLOT_MASK])) {
+            best = wheel->now + k;
+            break;
+        }
+    }
+    for (int level = 1; level < WTIMER_LEVELS; level++) {
+        int shift = level * WTIMER_BITS;
+        uint64_t base = wheel->now & ~((1ULL << shift) - 1);
+        int cur = (wheel->now >> shift) & SLOT_MASK;
+        for (int k = 0; k < WTIMER_SLOTS; k++) {
+            if (list_empty(&wheel->slots[level][(cur + k) & SLOT_MASK])) {
+                continue;
+            }
+            uint64_t t = base + ((uint64_t)k << shift);
+            if (t < wheel->now) {
+                // current slot already moved down, next turn
+                t += 1ULL << (shift + WTIMER_BITS);
+            }
+            if (t < best) {
+                best = t;
+            }
+            if (k > 0) {
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+int wtimer_next(struct wtimer_wheel *wheel, uint64_t now)
+{
+    if (wheel->count == 0) {
+        return -1;
+    }
+    uint64_t t = next_tick(wheel);
+    if (t <= now) {
+        return 0;
+    }
+    return t - now > INT_MAX ? INT_MAX : (int)(t - now);
+}
+
+int wtimer_advance(struct wtimer_wheel *wheel, uint64_t now)
+{
+    int cnt = 0;
+    if (now > wheel->time) {
+        wheel->time = now;
+    }
+    while (wheel->now <= now) {
+        uint64_t tick = wheel->count > 0 ? next_tick(wheel) : UINT64_MAX;
+        if (tick > now) {
+            // nothing until now, skip empty ticks
+            wheel->now = now + 1;
+            break;
+        }
+        wheel->now = tick;
+        if ((tick & SLOT_MASK) == 0) {
+            for (int level = 1; level < WTIMER_LEVELS; level++) {
+                if (cascade(wheel, level) != 0) {
+                    break;
+                }
+            }
+        }
+        struct wtimer_link list;
+        list_move(&wheel->slots[0][tick & SLOT_MASK], &list);
+        // timers added by callbacks go to later ticks
+        wheel->now = tick + 1;
+        while (!list_empty(&list)) {
+            struct wtimer *timer = (struct wtimer *)list.next;
+            list_del(&timer->link);
+            wheel->count--;
+            cnt++;
+            if (timer->cb) {
+                timer->cb(timer, timer->arg);
+            }
+        }
+    }
+    return cnt;
+}
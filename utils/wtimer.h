@@ -0,0 +1,75 @@
+#ifndef WTIMER_H
+#define WTIMER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// hierarchical timer wheel, one tick is one millisecond.
+// WTIMER_LEVELS levels of WTIMER_SLOTS slots, adding, removing and expiring a
+// timer is O(1). timers further than 2^24 ms (about 4.6 hours) are parked in
+// top level and placed again later.
+#define WTIMER_BITS     6
+#define WTIMER_SLOTS    (1 << WTIMER_BITS)
+#define WTIMER_LEVELS   4
+
+struct wtimer;
+
+// called when timer expires, timer is already removed and can be re-added.
+typedef void (*wtimer_cb)(struct wtimer *timer, void *arg);
+
+struct wtimer_link {
+    struct wtimer_link *next;
+    struct wtimer_link *prev;
+};
+
+// timer, usually embedded in its owner.
+struct wtimer {
+    struct wtimer_link link; // next is NULL if not pending
+    uint64_t expire;         // expire time, in milliseconds
+    wtimer_cb cb;
+    void *arg;
+};
+
+struct wtimer_wheel {
+    uint64_t now;   // next tick to run
+    uint64_t time;  // wheel time, latest time passed to wtimer_advance
+    int count;      // pending timers count
+    struct wtimer_link slots[WTIMER_LEVELS][WTIMER_SLOTS];
+};
+
+// get monotonic clock in milliseconds from wtime_clock, the time base of wheels.
+uint64_t wtimer_clock_ms(void);
+
+// init wheel starting at now milliseconds.
+void wtimer_wheel_init(struct wtimer_wheel *wheel, uint64_t now);
+
+// init timer, cb is called with arg when it expires.
+void wtimer_init(struct wtimer *timer, wtimer_cb cb, void *arg);
+
+// add timer to expire at expire milliseconds, re-add if already pending.
+// past time expires at next wtimer_advance.
+void wtimer_add(struct wtimer_wheel *wheel, struct wtimer *timer, uint64_t expire);
+
+// remove timer if pending.
+void wtimer_del(struct wtimer_wheel *wheel, struct wtimer *timer);
+
+// check if timer is pending, return 1 if pending, otherwise 0.
+int wtimer_pending(const struct wtimer *timer);
+
+// get milliseconds from now until next timer may expire, suitable as poll
+// timeout. it never exceeds the real expire time, but can be earlier when
+// far timers need to move down the wheel.
+// return 0 if some timers are due, -1 if no timer.
+int wtimer_next(struct wtimer_wheel *wheel, uint64_t now);
+
+// run all timers expired at now milliseconds, in expire order.
+// return expired timers count.
+int wtimer_advance(struct wtimer_wheel *wheel, uint64_t now);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // WTIMER_H
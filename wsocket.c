@@ -70,5 +70,33 @@ int wsocket_set_blocking(wsocket sock)
     return wsocket_configure_blocking(sock, 1);
 }
 
+int wsocket_sendv(wsocket sock, const wsocket_iovec *iov, int iovcnt)
+{
+#ifdef _WIN32
+    DWORD sent = 0;
+    if (WSASend(sock, (LPWSABUF)iov, iovcnt, &sent, 0, NULL, NULL) == SOCKET_ERROR) {
+        return WSOCKET_ERROR;
+    }
+    return (int)sent;
+#else
+    struct msghdr mh = {0};
+    mh.msg_iov = (struct iovec *)iov;
+    mh.msg_iovlen = iovcnt;
+    return sendmsg(sock, &mh, 0);
+#endif
+}
 
-
+int wsocket_poll(wsocket sock, int events, int timeout)
+{
+    wsocket_pollfd pfd = {0};
+    pfd.fd = sock;
+    pfd.events = ((events & WSOCKET_POLLIN) ? POLLIN : 0) |
+                 ((events & WSOCKET_POLLOUT) ? POLLOUT : 0);
+    int rv = wsocket_pollfds(&pfd, 1, timeout);
+    if (rv <= 0) {
+        return rv;
+    }
+    return ((pfd.revents & POLLIN) ? WSOCKET_POLLIN : 0) |
+           ((pfd.revents & POLLOUT) ? WSOCKET_POLLOUT : 0) |
+           ((pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) ? WSOCKET_POLLERR : 0);
+}
@@ -25,6 +25,7 @@ typedef SOCKET wsocket;
 #define WSOCKET_EWOULDBLOCK WSAEWOULDBLOCK
 #define WSOCKET_EAGAIN      WSOCKET_EWOULDBLOCK
 #define WSOCKET_EINPROGRESS WSAEWOULDBLOCK
+#define WSOCKET_EINTR       WSAEINTR
 
 // call this to init wsocket library.Setup WSA on win, do nothing on linux.
 #define WSOCKET_INIT()      wsocket_lib_init()
@@ -38,6 +39,16 @@ WSOCKET_API char* wsocket_strerror(int err);
 
 #define WSOCKET_GET_FD(wsock)   _open_osfhandle(wsock, 0)
 
+// scatter/gather buffer for wsocket_sendv
+typedef WSABUF wsocket_iovec;
+#define WSOCKET_IOV_SET(v, base, size)  ((v)->buf = (char *)(base), (v)->len = (ULONG)(size))
+#define WSOCKET_IOV_BASE(v)             ((v)->buf)
+#define WSOCKET_IOV_LEN(v)              ((v)->len)
+
+// poll for socket array, use POLLIN/POLLOUT events
+typedef WSAPOLLFD wsocket_pollfd;
+#define wsocket_pollfds(fds, n, timeout)    WSAPoll(fds, n, timeout)
+
 #else
 // linux socket api
 #define _GNU_SOURCE
@@ -57,6 +68,7 @@ typedef int wsocket;
 #define WSOCKET_EWOULDBLOCK EWOULDBLOCK
 #define WSOCKET_EAGAIN      WSOCKET_EWOULDBLOCK
 #define WSOCKET_EINPROGRESS EINPROGRESS
+#define WSOCKET_EINTR       EINTR
 
 // call this to init wsocket library. Setup WSA on win, do nothing on linux.
 #define WSOCKET_INIT()
@@ -68,6 +80,18 @@ typedef int wsocket;
 
 #define WSOCKET_GET_FD(wsock)   (wsock)
 
+#include <sys/uio.h>
+// scatter/gather buffer for wsocket_sendv
+typedef struct iovec wsocket_iovec;
+#define WSOCKET_IOV_SET(v, base, size)  ((v)->iov_base = (void *)(base), (v)->iov_len = (size))
+#define WSOCKET_IOV_BASE(v)             ((v)->iov_base)
+#define WSOCKET_IOV_LEN(v)              ((v)->iov_len)
+
+#include <poll.h>
+// poll for socket array, use POLLIN/POLLOUT events
+typedef struct pollfd wsocket_pollfd;
+#define wsocket_pollfds(fds, n, timeout)    poll(fds, n, timeout)
+
 #endif
 
 
@@ -79,6 +103,22 @@ WSOCKET_API int wsocket_set_nonblocking(wsocket sock);
 // WSOCKET_ERROR, and check wsocket_errno for details.
 WSOCKET_API int wsocket_set_blocking(wsocket sock);
 
+// send iovcnt buffers in one call, like writev.
+// return bytes sent, otherwise return WSOCKET_ERROR, and check wsocket_errno
+// for details.
+WSOCKET_API int wsocket_sendv(wsocket sock, const wsocket_iovec *iov, int iovcnt);
+
+// events for wsocket_poll
+#define WSOCKET_POLLIN      0x01
+#define WSOCKET_POLLOUT     0x02
+#define WSOCKET_POLLERR     0x04
+
+// wait for events on socket, at most timeout milliseconds, < 0 means forever.
+// works with any socket value, unlike select.
+// return ready events, 0 on timeout, otherwise return WSOCKET_ERROR, and check
+// wsocket_errno for details.
+WSOCKET_API int wsocket_poll(wsocket sock, int events, int timeout);
+
 
 #endif /* W_SOCKET_H */
 